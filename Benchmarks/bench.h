@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <utility>
+
+// Minimal timing harness. Each benchmark runs its body repeatedly until enough time
+// has passed to get a stable number, then reports the time per call and, when it's given
+// how much each call gets through, the rate.
+
+const double BENCH_MIN_SECONDS = 0.25;
+
+struct BenchResult
+{
+    double nsPerOp = 0.0;
+    double millionsPerSec = 0.0;    // Of whatever amountPerOp counts, 0 without one
+};
+
+// Store a result where the compiler has to assume it's read, so the work that made it
+// can't be optimised away
+template <typename T>
+inline volatile T BenchSink = T();
+
+template <typename T>
+void DoNotOptimize(const T& value)
+{
+    BenchSink<T> = value;
+}
+
+// amountPerOp is how much one call gets through, pixels or bytes say, and units names the
+// rate in millions a second: "Mpix/s", "MB/s". With no amount only the time is printed.
+template <typename Func>
+BenchResult RunBench(const char* name, double amountPerOp, const char* units, Func&& func)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Warm caches and let the CPU clock up before timing anything
+    func();
+
+    long long iterations = 1;
+    double seconds = 0.0;
+    while (true)
+    {
+        const Clock::time_point start = Clock::now();
+        for (long long i = 0; i < iterations; ++i)
+        {
+            func();
+        }
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= BENCH_MIN_SECONDS)
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    BenchResult result;
+    result.nsPerOp = (seconds * 1e9) / (double)iterations;
+    if (amountPerOp > 0.0)
+    {
+        result.millionsPerSec = (amountPerOp * (double)iterations) / seconds / 1e6;
+        printf("%-48s %12.1f ns/op %10.1f %s\n", name, result.nsPerOp, result.millionsPerSec, units);
+    }
+    else
+    {
+        printf("%-48s %12.1f ns/op\n", name, result.nsPerOp);
+    }
+    return result;
+}
+
+// Most of the drawing benchmarks count pixels
+template <typename Func>
+BenchResult RunBench(const char* name, double pixelsPerOp, Func&& func)
+{
+    return RunBench(name, pixelsPerOp, "Mpix/s", std::forward<Func>(func));
+}
+
+void RunConvertBenchmarks();
+
+// Image assets are loaded from assetDir, normally apps/assets/screen1. False if one of the
+// checks run alongside the benchmarks failed.
+bool RunDrawBenchmarks(const char* assetDir);
+
+// JSON documents are read from assetDir too
+void RunJSONBenchmarks(const char* assetDir);
@@ -0,0 +1,55 @@
+#include "bench.h"
+
+#include "microdraw_convert.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Same size as the screen1 panel
+const int CONVERT_WIDTH = 320;
+const int CONVERT_HEIGHT = 480;
+
+void RunConvertBenchmarks()
+{
+    const int numPixels = CONVERT_WIDTH * CONVERT_HEIGHT;
+    std::vector<uint32_t> src(numPixels);
+    for (int i = 0; i < numPixels; ++i)
+    {
+        src[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+
+    std::vector<uint16_t> expected(numPixels);
+    md_get_convert_row_func(MD_ConvertPath::Scalar)(src.data(), expected.data(), numPixels);
+
+    printf("XRGB8888 -> RGB565 (%dx%d), best path: %s\n", CONVERT_WIDTH, CONVERT_HEIGHT, md_get_convert_path_name(md_get_best_convert_path()));
+
+    std::vector<uint16_t> dst(numPixels);
+    for (int p = 0; p < (int)MD_ConvertPath::Count; ++p)
+    {
+        const MD_ConvertPath path = (MD_ConvertPath)p;
+        const MD_ConvertRowFunc convert = md_get_convert_row_func(path);
+        if (!convert)
+        {
+            printf("  %-46s unsupported\n", md_get_convert_path_name(path));
+            continue;
+        }
+
+        // Converting row by row, like blit_to_fb does
+        memset(dst.data(), 0, dst.size() * sizeof(uint16_t));
+        char name[64];
+        snprintf(name, sizeof(name), "  %s", md_get_convert_path_name(path));
+        RunBench(name, numPixels, [&]()
+        {
+            for (int y = 0; y < CONVERT_HEIGHT; ++y)
+            {
+                convert(&src[y * CONVERT_WIDTH], &dst[y * CONVERT_WIDTH], CONVERT_WIDTH);
+            }
+        });
+
+        if (memcmp(dst.data(), expected.data(), numPixels * sizeof(uint16_t)) != 0)
+        {
+            printf("  %s output does not match scalar!\n", md_get_convert_path_name(path));
+        }
+    }
+}
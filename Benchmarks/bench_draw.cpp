@@ -0,0 +1,266 @@
+#include "bench.h"
+
+#include "microdraw.h"
+#include "microdraw_headless.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Drawing benchmarks, run against the headless backend so the numbers measure the
+// drawing code rather than a window or display.
+
+const int DRAW_WIDTH = 320;
+const int DRAW_HEIGHT = 480;
+
+static std::string AssetPath(const char* assetDir, const char* file)
+{
+    std::string path = assetDir;
+    if (!path.empty() && path.back() != '/' && path.back() != '\\')
+    {
+        path += '/';
+    }
+    return path + file;
+}
+
+static void RunImageBenchmarks(const char* assetDir)
+{
+    MD_Image* back = md_load_image(AssetPath(assetDir, "back_ops.bmp").c_str());
+    MD_Image* keyed = md_load_image_with_key(AssetPath(assetDir, "back_ops.bmp").c_str(), 0, 0, 0);
+    MD_Image* reactor = md_load_image(AssetPath(assetDir, "reactor_red.bmp").c_str());
+    if (!back || !keyed || !reactor)
+    {
+        printf("Couldn't load images from %s, skipping image benchmarks\n", assetDir);
+        return;
+    }
+
+    const int backW = md_get_image_width(*back);
+    const int backH = md_get_image_height(*back);
+    const double backPixels = (double)backW * backH;
+
+    RunBench("md_draw_image", backPixels, [&]() { md_draw_image(*back, 0, 0); });
+    RunBench("md_draw_image colour key", backPixels, [&]() { md_draw_image(*keyed, 0, 0); });
+
+    md_set_colour_mod(*back, 128, 200, 255);
+    RunBench("md_draw_image colour mod", backPixels, [&]() { md_draw_image(*back, 0, 0); });
+    md_set_colour_mod(*back, 255, 255, 255);
+
+    md_set_colour_mod(*keyed, 128, 200, 255);
+    RunBench("md_draw_image colour key + mod", backPixels, [&]() { md_draw_image(*keyed, 0, 0); });
+    md_set_colour_mod(*keyed, 255, 255, 255);
+
+    const int reactorW = md_get_image_width(*reactor);
+    const int reactorH = md_get_image_height(*reactor);
+    const float scales[] = { 0.5f, 1.0f, 2.0f, 4.0f };
+    for (float scale : scales)
+    {
+        MD_Rect dest = { 0, 0, (int)(reactorW * scale), (int)(reactorH * scale) };
+        char name[64];
+        snprintf(name, sizeof(name), "md_draw_image_scaled x%.1f", scale);
+        RunBench(name, (double)dest.w * dest.h, [&]() { md_draw_image_scaled(*reactor, dest); });
+    }
+
+    md_destroy_image(*back);
+    md_destroy_image(*keyed);
+    md_destroy_image(*reactor);
+}
+
+static bool ImagesMatch(MD_Image& a, MD_Image& b)
+{
+    MD_PixelBuffer pixelsA;
+    MD_PixelBuffer pixelsB;
+    if (!md_get_image_pixels(a, pixelsA) || !md_get_image_pixels(b, pixelsB) || pixelsA.w != pixelsB.w || pixelsA.h != pixelsB.h)
+    {
+        return false;
+    }
+    const int rowBytes = pixelsA.w * (pixelsA.rgb565 ? 2 : 4);
+    for (int y = 0; y < pixelsA.h; ++y)
+    {
+        if (memcmp(pixelsA.pixels + y * pixelsA.pitch, pixelsB.pixels + y * pixelsB.pitch, rowBytes) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Not a benchmark, but the headless backend's output is used for golden images so it
+// has to clip like SDL. A scaled source rect hanging off the image keeps its scale and
+// shrinks the destination, so each draw should match drawing the clipped source into
+// the destination worked out here by hand. Built against SDL this checks SDL itself.
+static bool CheckScaledSourceClipping()
+{
+    MD_Image* source = md_create_image(16, 16);
+    // Canvas format targets, md_get_image_pixels can't read the alpha format md_create_image makes
+    MD_Image* clipped = md_create_image_with_key(64, 48, 0, 0, 0);
+    MD_Image* expected = md_create_image_with_key(64, 48, 0, 0, 0);
+    for (int y = 0; y < 16; ++y)
+    {
+        for (int x = 0; x < 16; ++x)
+        {
+            md_draw_pixel_to_image(*source, x, y, (uint8_t)(x * 16), (uint8_t)(y * 16), (uint8_t)((x ^ y) * 16));
+        }
+    }
+
+    struct Case
+    {
+        MD_Rect src;
+        MD_Rect dst;
+        MD_Rect clippedSrc;
+        MD_Rect clippedDst;
+    };
+    const Case cases[] = {
+        { { -4, -2, 16, 16 }, { 8, 8, 32, 32 }, { 0, 0, 12, 14 }, { 16, 12, 24, 28 } },     // x2, off the top left
+        { { 6, 8, 16, 16 }, { 0, 0, 48, 32 }, { 6, 8, 10, 8 }, { 0, 0, 30, 16 } },          // x3 by x2, off the bottom right
+    };
+
+    bool matches = true;
+    MD_Rect all = { 0, 0, 64, 48 };
+    for (const Case& test : cases)
+    {
+        MD_Rect src = test.src;
+        MD_Rect dst = test.dst;
+        MD_Rect clippedSrc = test.clippedSrc;
+        MD_Rect clippedDst = test.clippedDst;
+        // Stretch the source over all of both images, so nothing's left from the last case
+        md_draw_image_scaled(*source, nullptr, clipped, &all);
+        md_draw_image_scaled(*source, nullptr, expected, &all);
+        md_draw_image_scaled(*source, &src, clipped, &dst);
+        md_draw_image_scaled(*source, &clippedSrc, expected, &clippedDst);
+        matches = matches && ImagesMatch(*clipped, *expected);
+    }
+    printf("md_draw_image_scaled source clipping: %s\n", matches ? "matches" : "MISMATCH");
+
+    md_destroy_image(*source);
+    md_destroy_image(*clipped);
+    md_destroy_image(*expected);
+    return matches;
+}
+
+static void RunRectBenchmarks()
+{
+    MD_Rect full = { 0, 0, DRAW_WIDTH, DRAW_HEIGHT };
+    RunBench("md_filled_rect full screen", (double)full.w * full.h, [&]() { md_filled_rect(full, 0, 40, 0); });
+
+    MD_Rect small = { 20, 20, 16, 16 };
+    RunBench("md_filled_rect 16x16", (double)small.w * small.h, [&]() { md_filled_rect(small, 0, 255, 0); });
+}
+
+static void RunTextBenchmarks(const char* assetDir)
+{
+    const std::string fontPath = AssetPath(assetDir, "font.bmp");
+
+    Font monoFont;
+    monoFont.InitFont(fontPath.c_str(), 8, 8);
+    if (!monoFont.m_Surface)
+    {
+        printf("Couldn't load %s, skipping text benchmarks\n", fontPath.c_str());
+        return;
+    }
+
+    Font varFont;
+    varFont.InitFont(fontPath.c_str(), 8, 8);
+    varFont.MakeVariableWidth();
+
+    const char* text = "The odds of being born male are about 51.2%";
+    const double glyphPixels = (double)strlen(text) * 8 * 8;
+
+    RunBench("draw_text monospace", glyphPixels, [&]() { draw_text(monoFont, 4, 100, text, 1); });
+    RunBench("draw_text monospace x2", glyphPixels * 4, [&]() { draw_text(monoFont, 4, 100, text, 2); });
+    RunBench("draw_text variable width", glyphPixels, [&]() { draw_text(varFont, 4, 100, text, 1); });
+    RunBench("draw_text variable width x2", glyphPixels * 4, [&]() { draw_text(varFont, 4, 100, text, 2); });
+    RunBench("draw_text_cached variable width", glyphPixels, [&]() { draw_text_cached(varFont, 4, 100, text, 1); });
+
+    // Alternating the width makes every call wrap the text again
+    const char* fact = "The odds of being born male are about 51.2%, according to census.";
+    TextLayout layout;
+    int layoutWidth = 140;
+    RunBench("TextLayout::Layout 140px", (double)strlen(fact), "Mchar/s", [&]()
+    {
+        layoutWidth = layoutWidth == 140 ? 139 : 140;
+        layout.Layout(varFont, fact, layoutWidth);
+    });
+    RunBench("TextLayout::Layout unchanged", (double)strlen(fact), "Mchar/s", [&]() { layout.Layout(varFont, fact, layoutWidth); });
+    RunBench("TextLayout::Draw", glyphPixels, [&]() { layout.Draw(4, 100); });
+
+    md_clear_text_cache();
+
+    const double sheetPixels = (double)md_get_image_width(*varFont.m_Surface) * md_get_image_height(*varFont.m_Surface);
+    RunBench("Font::MakeVariableWidth", sheetPixels, [&]() { varFont.MakeVariableWidth(); });
+
+    md_destroy_image(*monoFont.m_Surface);
+    md_destroy_image(*varFont.m_Surface);
+}
+
+static void RunWidgetBenchmarks(const char* assetDir)
+{
+    // Same setup as the screen1 widgets
+    PanningImage topological;
+    topological.InitPanningImage(AssetPath(assetDir, "topological.bmp").c_str(), 11, 160, 138, 69);
+    if (topological.m_Image)
+    {
+        const MD_Rect& r = topological.m_Rect;
+        RunBench("PanningImage horizontal", (double)r.w * r.h, [&]() { topological.UpdateAndDrawPanningImage(); });
+        md_destroy_image(*topological.m_Image);
+    }
+
+    PanningImage sine;
+    sine.InitPanningImage(AssetPath(assetDir, "sine.bmp").c_str(), 273, 362, 32, 80);
+    sine.m_panHorizontal = false;
+    sine.m_Speed = 2.0f;
+    if (sine.m_Image)
+    {
+        const MD_Rect& r = sine.m_Rect;
+        RunBench("PanningImage vertical", (double)r.w * r.h, [&]() { sine.UpdateAndDrawPanningImage(); });
+        md_destroy_image(*sine.m_Image);
+    }
+
+    FlipBookImage planet;
+    planet.InitFlipbook(AssetPath(assetDir, "planet.bmp").c_str(), 5, 6, 13, 250);
+    if (planet.m_Image)
+    {
+        RunBench("FlipBookImage", (double)planet.m_Width * planet.m_Height, [&]() { planet.UpdateFlipbook(); });
+        md_destroy_image(*planet.m_Image);
+    }
+}
+
+static void RunPresentBenchmarks()
+{
+    // blit_to_fb runs inside md_render, which only converts what was marked dirty
+    RunBench("blit_to_fb full screen", (double)DRAW_WIDTH * DRAW_HEIGHT, []()
+    {
+        md_mark_all_dirty();
+        md_render();
+    });
+
+    MD_Rect panel = { 10, 160, 140, 70 };
+    RunBench("blit_to_fb 140x70 dirty rect", (double)panel.w * panel.h, [&]()
+    {
+        md_mark_dirty(panel);
+        md_render();
+    });
+}
+
+bool RunDrawBenchmarks(const char* assetDir)
+{
+    if (!md_init(DRAW_WIDTH, DRAW_HEIGHT))
+    {
+        printf("md_init failed, skipping draw benchmarks\n");
+        return true;
+    }
+
+    // The benchmarks call md_render() far more often than an app would, so no pacing
+    md_set_target_fps(0);
+    md_set_idle_fps(0);
+
+    printf("Drawing (%dx%d canvas)\n", DRAW_WIDTH, DRAW_HEIGHT);
+    const bool checksPassed = CheckScaledSourceClipping();
+    RunImageBenchmarks(assetDir);
+    RunRectBenchmarks();
+    RunTextBenchmarks(assetDir);
+    RunWidgetBenchmarks(assetDir);
+    RunPresentBenchmarks();
+
+    md_deinit();
+    return checksPassed;
+}
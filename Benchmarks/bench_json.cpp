@@ -0,0 +1,291 @@
+#include "bench.h"
+
+#include "microdraw.h"
+#include "microdraw_scan.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// JSON parsing benchmarks, using the documents screen1 reloads
+
+static std::string AssetPath(const char* assetDir, const char* file)
+{
+    std::string path = assetDir;
+    if (!path.empty() && path.back() != '/' && path.back() != '\\')
+    {
+        path += '/';
+    }
+    return path + file;
+}
+
+static std::string ReadAsset(const char* assetDir, const char* file)
+{
+    std::ifstream stream(AssetPath(assetDir, file), std::ios::binary);
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    return buffer.str();
+}
+
+// Size of an asset in bytes, for the rate of the benchmarks that read it
+static double AssetBytes(const std::string& path)
+{
+    MD_FileInfo info;
+    return md_get_file_info(path.c_str(), info) ? (double)info.size : 0.0;
+}
+
+static void RunDocumentBenchmarks(const char* name, const std::string& json)
+{
+    char label[64];
+    const double bytes = (double)json.size();
+
+    JSONVal heapDoc;
+    snprintf(label, sizeof(label), "ParseJSON %s heap", name);
+    RunBench(label, bytes, "MB/s", [&]() { ParseJSON(json.c_str(), heapDoc); });
+
+    JSONVal arenaDoc;
+    arenaDoc.UseArena(16 * 1024);
+    snprintf(label, sizeof(label), "ParseJSON %s arena", name);
+    RunBench(label, bytes, "MB/s", [&]() { ParseJSON(json.c_str(), arenaDoc); });
+
+    const MD_JSONArenaStats& stats = arenaDoc.GetArena()->GetStats();
+    printf("  %zu bytes of JSON, arena peak %zu of %zu bytes, %zu overflowed\n",
+        json.size(), stats.peak_bytes, stats.capacity_bytes, stats.overflow_bytes);
+
+    JSONTape tape;
+    snprintf(label, sizeof(label), "JSONTape::Parse %s", name);
+    RunBench(label, bytes, "MB/s", [&]() { tape.Parse(json.c_str()); });
+    printf("  %zu nodes of %zu bytes\n", tape.m_Nodes.size(), sizeof(JSONTape::Node));
+}
+
+static void RunLookupBenchmarks(const std::string& weather)
+{
+    JSONVal doc;
+    ParseJSON(weather.c_str(), doc);
+    JSONTape tape;
+    tape.Parse(weather.c_str());
+
+    // The lookups screen1 makes after each reload
+    RunBench("JSONVal weather lookups", 0.0, [&]()
+    {
+        DoNotOptimize(doc.GetObject("current").GetObject("temperature_2m").GetAsFloat());
+        DoNotOptimize(doc.GetObject("daily").GetObject("temperature_2m_min").GetArrayVal(0).GetAsFloat());
+        DoNotOptimize(doc.GetObject("current").GetObject("weather_code").GetAsInt());
+    });
+    RunBench("JSONTape weather lookups", 0.0, [&]()
+    {
+        DoNotOptimize(tape.GetObject("current").GetObject("temperature_2m").GetAsFloat());
+        DoNotOptimize(tape.GetObject("daily").GetObject("temperature_2m_min").GetArrayVal(0).GetAsFloat());
+        DoNotOptimize(tape.GetObject("current").GetObject("weather_code").GetAsInt());
+    });
+
+    // Paths split up once, then looked up each time
+    const JSONPath currentTemperature("current.temperature_2m");
+    const JSONPath dailyMinimum("daily.temperature_2m_min[0]");
+    const JSONPath weatherCode("current.weather_code");
+    RunBench("JSONVal weather path lookups", 0.0, [&]()
+    {
+        DoNotOptimize(doc.Get(currentTemperature).GetAsFloat());
+        DoNotOptimize(doc.Get(dailyMinimum).GetAsFloat());
+        DoNotOptimize(doc.Get(weatherCode).GetAsInt());
+    });
+    RunBench("JSONTape weather path lookups", 0.0, [&]()
+    {
+        DoNotOptimize(tape.Get(currentTemperature).GetAsFloat());
+        DoNotOptimize(tape.Get(dailyMinimum).GetAsFloat());
+        DoNotOptimize(tape.Get(weatherCode).GetAsInt());
+    });
+    RunBench("JSONPath parse", 0.0, [&]() { DoNotOptimize(JSONPath("daily.temperature_2m_min[0]").m_Steps.size()); });
+
+    // The same four values bound to a stream, with the parse included
+    JSONStream stream;
+    int code = 0;
+    float temperature = 0.0f;
+    float minimum = 0.0f;
+    float maximum = 0.0f;
+    stream.Bind("current.weather_code", code);
+    stream.Bind("current.temperature_2m", temperature);
+    stream.Bind("daily.temperature_2m_min[0]", minimum);
+    stream.Bind("daily.temperature_2m_max[0]", maximum);
+    RunBench("JSONStream weather bound values", (double)weather.size(), "MB/s", [&]()
+    {
+        stream.Begin();
+        stream.Feed(weather.data(), weather.size());
+        stream.End();
+        DoNotOptimize(temperature + minimum + maximum + (float)code);
+    });
+}
+
+static void RunFileBenchmarks(const char* assetDir)
+{
+    const std::string path = AssetPath(assetDir, "weather.json");
+    const double bytes = AssetBytes(path);
+
+    JSONVal doc;
+    RunBench("ParseJSONFile weather.json JSONVal", bytes, "MB/s", [&]() { ParseJSONFile(path.c_str(), doc); });
+
+    JSONTape tape;
+    RunBench("ParseJSONFile weather.json JSONTape", bytes, "MB/s", [&]()
+    {
+        // Forget the file so it gets read and parsed every time
+        tape.Clear();
+        ParseJSONFile(path.c_str(), tape);
+    });
+    RunBench("ParseJSONFile weather.json unchanged", 0.0, [&]() { ParseJSONFile(path.c_str(), tape); });
+
+    JSONStream stream;
+    RunBench("ParseJSONFile weather.json JSONStream", bytes, "MB/s", [&]()
+    {
+        stream.m_Source.Forget();
+        ParseJSONFile(path.c_str(), stream);
+    });
+}
+
+// screen1's periodic reload, before and after MD_DataSources
+static void RunReloadBenchmarks(const char* assetDir)
+{
+    const std::string valuesPath = AssetPath(assetDir, "values.txt");
+    const std::string weatherPath = AssetPath(assetDir, "weather.json");
+    const std::string factPath = AssetPath(assetDir, "uselessfact.json");
+
+    const double bytes = AssetBytes(valuesPath) + AssetBytes(weatherPath) + AssetBytes(factPath);
+
+    Values values;
+    JSONTape weather;
+    JSONTape fact;
+    RunBench("Reload everything", bytes, "MB/s", [&]()
+    {
+        values.clear();
+        LoadConfigToMap(valuesPath.c_str(), values);
+        weather.Clear();
+        ParseJSONFile(weatherPath.c_str(), weather);
+        fact.Clear();
+        ParseJSONFile(factPath.c_str(), fact);
+    });
+
+    MD_DataSources sources;
+    sources.Subscribe(valuesPath.c_str(), [&](const char* text, size_t size) { values.clear(); LoadConfigText(text, size, values); });
+    sources.Subscribe(weatherPath.c_str(), [&](const char* text, size_t) { weather.Parse(text); });
+    sources.Subscribe(factPath.c_str(), [&](const char* text, size_t) { fact.Parse(text); });
+    RunBench("MD_DataSources::Poll unchanged", 0.0, [&]() { sources.Poll(); });
+    const MD_DataSourceStats& stats = sources.GetStats();
+    printf("  %llu checks, %llu reads, %llu changes\n",
+        (unsigned long long)stats.checks, (unsigned long long)stats.reads, (unsigned long long)stats.changes);
+}
+
+// values.txt as a Values map and as ConfigValues, and a config with many more keys
+static void RunConfigBenchmarks(const char* assetDir)
+{
+    const std::string valuesPath = AssetPath(assetDir, "values.txt");
+    const double valuesBytes = AssetBytes(valuesPath);
+    Values values;
+    ConfigValues config;
+    RunBench("LoadConfigToMap values.txt", valuesBytes, "MB/s", [&]()
+    {
+        values.clear();
+        LoadConfigToMap(valuesPath.c_str(), values);
+    });
+    RunBench("ConfigValues::Load values.txt", valuesBytes, "MB/s", [&]() { config.Load(valuesPath.c_str()); });
+
+    std::string text;
+    for (int i = 0; i < 1000; ++i)
+    {
+        text += (i % 4 ? "setting" : "feed") + std::to_string(i) + "=SOME VALUE " + std::to_string(i) + "\n";
+    }
+    RunBench("LoadConfigText 1000 keys", (double)text.size(), "MB/s", [&]()
+    {
+        values.clear();
+        LoadConfigText(text.c_str(), text.size(), values);
+    });
+    RunBench("ConfigValues::LoadText 1000 keys", (double)text.size(), "MB/s", [&]() { config.LoadText(text.c_str(), text.size()); });
+
+    RunBench("Values lookups", 0.0, [&]()
+    {
+        DoNotOptimize(values.find("setting501")->second.size());
+        DoNotOptimize(values.find("feed500")->second.size());
+        DoNotOptimize(values.count("missing"));
+    });
+    RunBench("ConfigValues lookups", 0.0, [&]()
+    {
+        DoNotOptimize(config.Get("setting501").size());
+        DoNotOptimize(config.Get("feed500").size());
+        DoNotOptimize(config.Get("missing").size());
+    });
+
+    // Counting the feed lines, as FeedView did and does
+    RunBench("Values feed scan", 0.0, [&]()
+    {
+        for (const auto& value : values)
+        {
+            DoNotOptimize(value.first.compare(0, 4, "feed") == 0);
+        }
+    });
+    RunBench("ConfigValues::FindPrefix feed", 0.0, [&]()
+    {
+        size_t first = 0;
+        DoNotOptimize(config.FindPrefix("feed", first));
+    });
+}
+
+// A bigger document than the assets, an indented array of records with long strings, to
+// show the per byte cost of scanning
+static std::string MakeLargeDocument(const std::string& fact)
+{
+    std::string json = "[\n";
+    for (int i = 0; i < 256; ++i)
+    {
+        json += i ? ",\n    " : "    ";
+        json += fact;
+    }
+    json += "\n]\n";
+    return json;
+}
+
+static void RunScanBenchmarks(const std::string& json)
+{
+    const double bytes = (double)json.size();
+    std::vector<uint32_t> indices;
+    RunBench("md_json_index large", bytes, "MB/s", [&]() { md_json_index(json.c_str(), json.size(), indices); });
+    printf("  %zu bytes, %zu tokens\n", json.size(), indices.size());
+
+    JSONTape tape;
+    RunBench("JSONTape::Parse large", bytes, "MB/s", [&]() { tape.Parse(json.c_str()); });
+
+    JSONVal doc;
+    doc.UseArena(1024 * 1024);
+    RunBench("ParseJSON large arena", bytes, "MB/s", [&]() { ParseJSON(json.c_str(), doc); });
+
+    // Fed in 4KB pieces as ParseJSONFile would
+    JSONStream stream;
+    std::string text;
+    stream.Bind("[255].text", text);
+    RunBench("JSONStream large", bytes, "MB/s", [&]()
+    {
+        stream.Begin();
+        for (size_t offset = 0; offset < json.size(); offset += 4096)
+        {
+            stream.Feed(json.data() + offset, std::min<size_t>(4096, json.size() - offset));
+        }
+        stream.End();
+    });
+}
+
+void RunJSONBenchmarks(const char* assetDir)
+{
+    const std::string weather = ReadAsset(assetDir, "weather.json");
+    const std::string fact = ReadAsset(assetDir, "uselessfact.json");
+    if (weather.empty() || fact.empty())
+    {
+        printf("Couldn't load JSON from %s, skipping JSON benchmarks\n", assetDir);
+        return;
+    }
+
+    printf("JSON\n");
+    RunDocumentBenchmarks("weather.json", weather);
+    RunDocumentBenchmarks("uselessfact.json", fact);
+    RunLookupBenchmarks(weather);
+    RunFileBenchmarks(assetDir);
+    RunReloadBenchmarks(assetDir);
+    RunConfigBenchmarks(assetDir);
+    RunScanBenchmarks(MakeLargeDocument(fact));
+}
@@ -0,0 +1,16 @@
+#include "bench.h"
+
+int main(int argc, char* argv[])
+{
+    // Working directory is the project directory when run from Visual Studio
+    const char* assetDir = argc > 1 ? argv[1] : "../apps/assets/screen1";
+
+    RunConvertBenchmarks();
+    printf("\n");
+    const bool checksPassed = RunDrawBenchmarks(assetDir);
+    printf("\n");
+    RunJSONBenchmarks(assetDir);
+
+    // Fail the run, so a script notices, when drawing came out wrong
+    return checksPassed ? 0 : 1;
+}
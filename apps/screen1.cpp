@@ -1,7 +1,5 @@
 #include "microdraw.h"
-
-#define MICRODRAW_SDL
-#include "microdraw_sdl.h"
+#include "microdraw_watch.h"
 
 #include <fstream>
 #include <iostream>
@@ -65,7 +63,11 @@ struct TextWall
         memset(m_Text + (line * m_CharW), 0, m_CharW);
         memcpy(m_Text + (line * m_CharW), text, copy_len);
     }
-    void SetWrappedLine(int line, const char* text);
+    // Wrap text to the width of the wall, for DrawWrappedText. Only redone when the text changes.
+    void SetWrappedText(const char* text)
+    {
+        m_Layout.Layout(*m_Font, text, m_Rect.w);
+    }
     void Clear()
     {
         memset(m_Text, 0, m_CharW * m_CharH);
@@ -78,67 +80,25 @@ struct TextWall
         {
             memcpy(line, &m_Text[y * m_CharW], m_CharW);
             line[m_CharW] = '\0';
-            draw_text(*m_Font, m_Rect.x, m_Rect.y + (y * m_Font->m_GlyphSurfaceH), line, 1);
+            draw_text_cached(*m_Font, m_Rect.x, m_Rect.y + (y * m_Font->m_GlyphSurfaceH), line, 1);
         }
         md_set_colour_mod(*m_Font->m_Surface, 255, 255, 255);
     }
+    void DrawWrappedText(uint8_t r, uint8_t g, uint8_t b)
+    {
+        md_set_colour_mod(*m_Font->m_Surface, r, g, b);
+        m_Layout.Draw(m_Rect.x, m_Rect.y, m_Rect.h);
+        md_set_colour_mod(*m_Font->m_Surface, 255, 255, 255);
+    }
 
     MD_Rect m_Rect;
     Font* m_Font = nullptr;
+    TextLayout m_Layout;
     char* m_Text = nullptr;
     int m_CharW = 0;
     int m_CharH = 0;
 };
 
-void TextWall::SetWrappedLine(int line, const char* text)
-{
-    const char* cursor = text;
-    int charsLeft = (int)strlen(text);
-    while (charsLeft > 0)
-    {
-        if (line >= m_CharH)
-        {
-            // Out of space
-            break;
-        }
-
-        char* currLine = m_Text + (line * m_CharW);
-        memset(currLine, 0, m_CharW);
-
-        if (charsLeft <= m_CharW)
-        {
-            // Write all that's left
-            memcpy(currLine, cursor, charsLeft);
-            break;
-        }
-
-        // Find closest next break
-        int nextBreak = 0;
-        int skip = 0;
-        for (int i = 0; i < m_CharW; ++i)
-        {
-            if (cursor[i] == ' ')
-            {
-                nextBreak = i;
-                skip = 1; //skip space
-            }
-        }
-
-        if (nextBreak == 0)
-        {
-            // no break, fake a position
-            nextBreak = m_CharW;
-        }
-
-        // copy to break
-        memcpy(currLine, cursor, nextBreak);
-        charsLeft -= nextBreak;
-        cursor += nextBreak + skip;
-        line += 1;
-        
-    }
-}
-
 void TextWall::AddToTopOfWall(const char* text)
 {
     // Shuffle existing lines down
@@ -217,10 +177,10 @@ void drawSpinningCube(char* ptr, int width, int height, float A, float B, float
 class FeedView
 {
 public:
-    void UpdateFeed(TextWall& textWall, const Values& values);
+    void UpdateFeed(TextWall& textWall, const ConfigValues& values);
 };
 
-void FeedView::UpdateFeed(TextWall& textWall, const Values& values)
+void FeedView::UpdateFeed(TextWall& textWall, const ConfigValues& values)
 {
     //Scroll lines
     //for (int y = 1; y < m_CharH; ++y)
@@ -229,35 +189,14 @@ void FeedView::UpdateFeed(TextWall& textWall, const Values& values)
     //}
     //memset(m_FeedText + ((m_CharH - 1) * m_CharW), 0, m_CharW);
 
-    // Count num feed lines in text file
-    int count = 0;
-    for (auto& v : values)
-    {
-        if (v.first.find_first_of("feed") == 0)
-        {
-            ++count;
-        }
-    }
+    // The feed lines in the text file are the keys starting with "feed"
+    size_t first = 0;
+    const size_t count = values.FindPrefix("feed", first);
 
     const char* new_feed_line = " - - - - - ";
     if (count > 0)
     {
-        int selected = rand() % count;
-        for (auto& v : values)
-        {
-            if (v.first.find_first_of("feed") == 0)
-            {
-                if (selected == 0)
-                {
-                    new_feed_line = v.second.c_str();
-                    break;
-                }
-                else
-                {
-                    --selected;
-                }
-            }
-        }
+        new_feed_line = values.GetValue(first + rand() % count).data();
     }
 
     textWall.AddToTopOfWall(new_feed_line);
@@ -266,56 +205,23 @@ void FeedView::UpdateFeed(TextWall& textWall, const Values& values)
 class UselessFactData
 {
 public:
-    bool UpdateUselessFact()
+    // Runs on the watcher thread whenever the file changes
+    std::shared_ptr<const std::string> ParseUselessFact(const char* json)
     {
-        const std::string old_fact = m_UselessFact;
-
-        ParseJSONFile("uselessfact.json", m_Doc);
-        m_UselessFact = m_Doc.GetObject("text").GetAsString();
-
-        if ((old_fact != m_UselessFact))
+        if (!m_Doc.Parse(json))
         {
-            return true;
+            return nullptr;
         }
-
-        return false;
+        return std::make_shared<const std::string>(m_Doc.GetObject("text").GetAsString());
     }
 
-    JSONVal m_Doc;
-    std::string m_UselessFact;
+    JSONTape m_Doc;
 };
 
 
 class WeatherData
 {
 public:
-
-    bool UpdateWeatherData()
-    {
-        const int old_CurrentWeatherCode = m_CurrentWeatherCode;
-        const float old_CurrentTemp = m_CurrentTemp;
-        const float old_TempMin = m_TempMin;
-        const float old_TempMax = m_TempMax;
-
-        ParseJSONFile("weather.json", m_WeatherDoc);
-        m_CurrentWeatherCode = m_WeatherDoc.GetObject("current").GetObject("weather_code").GetAsInt();
-        m_CurrentWeatherDesc = GetWeatherDescription(m_CurrentWeatherCode);
-        m_CurrentTemp = m_WeatherDoc.GetObject("current").GetObject("temperature_2m").GetAsFloat();
-        m_TempMin = m_WeatherDoc.GetObject("daily").GetObject("temperature_2m_min").GetArrayVal(0).GetAsFloat();
-        m_TempMax = m_WeatherDoc.GetObject("daily").GetObject("temperature_2m_max").GetArrayVal(0).GetAsFloat();
-
-        if ((old_CurrentWeatherCode != m_CurrentWeatherCode)
-            || (old_CurrentTemp != m_CurrentTemp)
-            || (old_TempMin != m_TempMin)
-            || (old_TempMax != m_TempMax)
-            )
-        {
-            return true;
-            }
-
-        return false;
-    }
-
     /**
      * Converts a Met Office DataPoint weather code to a short descriptive string.
      * Reference: https://www.metoffice.gov.uk/services/data/datapoint/code-definitions
@@ -357,7 +263,6 @@ public:
         return "UNKNOWN";
     }
 
-    JSONVal m_WeatherDoc;
     int m_CurrentWeatherCode = 0;
     std::string m_CurrentWeatherDesc;
     float m_CurrentTemp = 0.0f;
@@ -365,6 +270,47 @@ public:
     float m_TempMax = 0.0f;
 };
 
+// Reads weather.json on the watcher thread, handing each result to the frame loop as a
+// new WeatherData
+class WeatherParser
+{
+public:
+    WeatherParser()
+    {
+        // Only these are read out of the forecast, the rest is skipped as it streams past
+        m_WeatherStream.Bind("current.weather_code", m_Weather.m_CurrentWeatherCode);
+        m_WeatherStream.Bind("current.temperature_2m", m_Weather.m_CurrentTemp);
+        m_WeatherStream.Bind("daily.temperature_2m_min[0]", m_Weather.m_TempMin);
+        m_WeatherStream.Bind("daily.temperature_2m_max[0]", m_Weather.m_TempMax);
+    }
+
+    // The stream writes into this object's own members, so a copy would write into the original
+    WeatherParser(const WeatherParser&) = delete;
+    WeatherParser& operator=(const WeatherParser&) = delete;
+
+    std::shared_ptr<const WeatherData> ParseWeatherData(const char* json, size_t size)
+    {
+        // Anything this file leaves out reads as missing, as it did from a JSONVal, rather
+        // than keeping the value from the last file
+        m_Weather.m_CurrentWeatherCode = -1;
+        m_Weather.m_CurrentTemp = 0.0f;
+        m_Weather.m_TempMin = 0.0f;
+        m_Weather.m_TempMax = 0.0f;
+
+        m_WeatherStream.Begin();
+        m_WeatherStream.Feed(json, size);
+        if (!m_WeatherStream.End())
+        {
+            return nullptr;
+        }
+        m_Weather.m_CurrentWeatherDesc = m_Weather.GetWeatherDescription(m_Weather.m_CurrentWeatherCode);
+        return std::make_shared<const WeatherData>(m_Weather);
+    }
+
+    JSONStream m_WeatherStream;
+    WeatherData m_Weather;
+};
+
 class ControlIndicator
 {
 public:
@@ -466,7 +412,10 @@ Gradient::~Gradient()
 
 void Gradient::Reset()
 {
-    md_destroy_image_impl(*m_Surface);
+    if (m_Surface)
+    {
+        md_destroy_image(*m_Surface);
+    }
     m_Surface = nullptr;
 }
 
@@ -583,10 +532,10 @@ void WeatherSat::DrawWeatherSat(Font& font)
     m_satPlanet.UpdateFlipbook();
 
     snprintf(buff, sizeof(buff), "%0.1fC", m_WeatherData->m_TempMax);
-    draw_text(font, 15, 255, buff, 1);
+    draw_text_cached(font, 15, 255, buff, 1);
 
     snprintf(buff, sizeof(buff), "%0.1fC", m_WeatherData->m_TempMin);
-    draw_text(font, 15, 360, buff, 1);
+    draw_text_cached(font, 15, 360, buff, 1);
 
     if (m_WeatherData->m_TempMin == m_WeatherData->m_TempMax)
     {
@@ -600,12 +549,15 @@ void WeatherSat::DrawWeatherSat(Font& font)
     md_filled_rect(currTempRect, 255, 255, 255);
 
     snprintf(buff, sizeof(buff), "%0.1fC", m_WeatherData->m_CurrentTemp);
-    draw_text(font, 28, currTempY - (font.m_GlyphSurfaceH/3), buff, 1);
+    draw_text_cached(font, 28, currTempY - (font.m_GlyphSurfaceH/3), buff, 1);
 }
 
 int main(int argc, char* argv[]) 
 {
-    if (!md_init(SCREEN_WIDTH, SCREEN_HEIGHT))
+    // Hundreds of glyph blits a frame, so let them be batched up
+    MD_InitOptions options;
+    options.batch_draws = true;
+    if (!md_init(SCREEN_WIDTH, SCREEN_HEIGHT, options))
     {
         return -1;
     }
@@ -613,7 +565,6 @@ int main(int argc, char* argv[])
     srand((unsigned int)time(NULL));
 
     WeatherData weather;
-    UselessFactData uselessFact;
 
     ReactorCell reactorCells[] = {
         { 18,  399 },
@@ -645,7 +596,7 @@ int main(int argc, char* argv[])
     };
     constexpr int numReactorCells = 24;
 
-    std::map<std::string, std::string> values;
+    std::shared_ptr<const ConfigValues> values = std::make_shared<const ConfigValues>();
 
     MD_Image* bg = md_load_image("back_ops.bmp");
     MD_Image* reactor_red = md_load_image_with_key("reactor_red.bmp", 0, 0, 0);
@@ -693,32 +644,63 @@ int main(int argc, char* argv[])
         sine.m_Scroll = (float)(i * 4);
     }
 
-    LoadConfigToMap("values.txt", values);
-
-
     bool run = true;
     int frame = 0;
 
     WeatherSat weatherSat;
     weatherSat.InitWeatherSat(weather);
 
-    while (run)
+    // Data files are parsed on the watcher thread as soon as they change. Each frame picks
+    // up whatever was published last, which costs nothing when there's nothing new.
+    MD_Snapshot<ConfigValues> valuesSnapshot;
+    MD_Snapshot<WeatherData> weatherSnapshot;
+    MD_Snapshot<std::string> uselessFactSnapshot;
+    uint32_t valuesVersion = 0;
+    uint32_t weatherVersion = 0;
+    uint32_t uselessFactVersion = 0;
+    std::shared_ptr<const WeatherData> latestWeather;
+    std::shared_ptr<const std::string> uselessFact;
+
+    WeatherParser weatherParser;
+    UselessFactData uselessFactParser;
+    MD_FileWatcher watcher;
+    watcher.Watch("values.txt", [&](const char* text, size_t size)
     {
-        static const int reloadCntMax = 100;
-        if (reloadValsCnt == 0)
+        std::shared_ptr<ConfigValues> parsed = std::make_shared<ConfigValues>();
+        parsed->LoadText(text, size);
+        valuesSnapshot.Publish(std::move(parsed));
+    });
+    watcher.Watch("weather.json", [&](const char* text, size_t size)
+    {
+        if (std::shared_ptr<const WeatherData> parsed = weatherParser.ParseWeatherData(text, size))
         {
-            values.clear();
-            LoadConfigToMap("values.txt", values);
-            if (weather.UpdateWeatherData())
-            {
-                weatherSat.OnWeatherUpdated();
-            }
-
-            if (uselessFact.UpdateUselessFact())
-            {
+            weatherSnapshot.Publish(std::move(parsed));
+        }
+    });
+    watcher.Watch("uselessfact.json", [&](const char* text, size_t)
+    {
+        if (std::shared_ptr<const std::string> parsed = uselessFactParser.ParseUselessFact(text))
+        {
+            uselessFactSnapshot.Publish(std::move(parsed));
+        }
+    });
+    watcher.Start();
 
-            }
+    while (run)
+    {
+        valuesSnapshot.PickUp(values, valuesVersion);
+        if (weatherSnapshot.PickUp(latestWeather, weatherVersion))
+        {
+            weather = *latestWeather;
+            weatherSat.OnWeatherUpdated();
+        }
+        if (uselessFactSnapshot.PickUp(uselessFact, uselessFactVersion))
+        {
+            operationsText.SetWrappedText(uselessFact->c_str());
         }
+
+        // Pulses the first reactor cell
+        static const int reloadCntMax = 100;
         reloadValsCnt = (reloadValsCnt + 1) % reloadCntMax;
         reloadValsT = (float)reloadValsCnt / (float)reloadCntMax;
 
@@ -742,10 +724,10 @@ int main(int argc, char* argv[])
 
 
         snprintf(buff, sizeof(buff), "%s", weather.m_CurrentWeatherDesc.c_str());
-        draw_text(varFont, 50, 110, buff, 1);
+        draw_text_cached(varFont, 50, 110, buff, 1);
 
         snprintf(buff, sizeof(buff), "Current Temp %0.1fC", weather.m_CurrentTemp);
-        draw_text(varFont, 50, 120, buff, 1);
+        draw_text_cached(varFont, 50, 120, buff, 1);
 
         //snprintf(buff, sizeof(buff), "%0.1fC Min %0.1fC Max", weather.m_TempMin, weather.m_TempMax);
         //draw_text(canvas, varFont, 20, 115, buff, 2);
@@ -764,10 +746,8 @@ int main(int argc, char* argv[])
 
         if (operationsFeedMode == 0)
         {
-            //operationsFeed.UpdateFeed(operationsText, values);
-            operationsText.Clear();
-            operationsText.SetWrappedLine(0, uselessFact.m_UselessFact.c_str());
-            operationsText.DrawTextWall(255, 255, 255);
+            //operationsFeed.UpdateFeed(operationsText, *values);
+            operationsText.DrawWrappedText(255, 255, 255);
         }
         else
         {
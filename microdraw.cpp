@@ -1,12 +1,27 @@
 #include "microdraw.h"
+#include "microdraw_profile.h"
+#include "microdraw_convert.h"
+#include "microdraw_file.h"
+#include "microdraw_scan.h"
 
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <charconv>
 
 #ifdef __linux__
+#include <time.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -16,445 +31,2628 @@
 
 void md_get_pixel_x_bounds(MD_Image& image, const MD_Rect& rect, int& xLeftOut, int& xRightOut);
 
-void Font::InitFont(const char* bmpName, int glyphWidth, int glyphHeight)
+bool md_intersect_rect(const MD_Rect& a, const MD_Rect& b, MD_Rect& out)
 {
-	m_GlyphSurfaceW = glyphWidth;
-	m_GlyphSurfaceH = glyphHeight;
-	m_Surface = md_load_image_with_key(bmpName, 0, 0, 0);
+	const int x0 = std::max(a.x, b.x);
+	const int y0 = std::max(a.y, b.y);
+	const int x1 = std::min(a.x + a.w, b.x + b.w);
+	const int y1 = std::min(a.y + a.h, b.y + b.h);
+	if (x1 <= x0 || y1 <= y0)
+	{
+		out = { 0, 0, 0, 0 };
+		return false;
+	}
+	out = { x0, y0, x1 - x0, y1 - y0 };
+	return true;
 }
 
-void Font::InitFontFromImageData(const char* data, int w, int h, int glyphWidth, int glyphHeight)
+MD_Rect md_union_rect(const MD_Rect& a, const MD_Rect& b)
 {
-	m_GlyphSurfaceW = glyphWidth;
-	m_GlyphSurfaceH = glyphHeight;
-	m_Surface = md_load_image_from_565_data_with_key(data, w, h, 0, 0, 0);
+	const int x0 = std::min(a.x, b.x);
+	const int y0 = std::min(a.y, b.y);
+	const int x1 = std::max(a.x + a.w, b.x + b.w);
+	const int y1 = std::max(a.y + a.h, b.y + b.h);
+	return { x0, y0, x1 - x0, y1 - y0 };
 }
 
-int Font::GetGlyphWidth(char c) const
+static int RectArea(const MD_Rect& rect)
 {
-	if (m_Monospace)
+	return rect.w * rect.h;
+}
+
+void DirtyRectList::Add(const MD_Rect& rect)
+{
+	if (rect.w <= 0 || rect.h <= 0)
 	{
-		return m_GlyphSurfaceW;
+		return;
+	}
+
+	MD_Rect pending = rect;
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (int i = 0; i < m_Count; ++i)
+		{
+			// Merge when the combined box wastes little compared to keeping both. This also
+			// catches overlapping and edge-adjacent rects, like a run of glyphs.
+			const MD_Rect joined = md_union_rect(m_Rects[i], pending);
+			const int separate = RectArea(m_Rects[i]) + RectArea(pending);
+			if (RectArea(joined) <= separate + separate / 4)
+			{
+				pending = joined;
+				m_Rects[i] = m_Rects[--m_Count];
+				merged = true;
+				break;
+			}
+		}
 	}
 
-	return m_GlyphData[c].width;
+	if (m_Count < MD_MAX_DIRTY_RECTS)
+	{
+		m_Rects[m_Count++] = pending;
+		return;
+	}
+
+	// Out of slots, so grow whichever rect needs the fewest extra pixels to cover it
+	int best = 0;
+	int bestGrowth = INT32_MAX;
+	for (int i = 0; i < m_Count; ++i)
+	{
+		const int growth = RectArea(md_union_rect(m_Rects[i], pending)) - RectArea(m_Rects[i]);
+		if (growth < bestGrowth)
+		{
+			best = i;
+			bestGrowth = growth;
+		}
+	}
+	pending = md_union_rect(m_Rects[best], pending);
+	m_Rects[best] = m_Rects[--m_Count];
+	Add(pending);
 }
 
-int Font::GetGlyphHeight(char c) const
+void DirtyRectList::Clear()
 {
-	return m_GlyphSurfaceH;
+	m_Count = 0;
 }
 
-MD_Rect Font::GetGlpyphRect(char c) const
+int DirtyRectList::GetPixelCount() const
 {
-	// Calculate position in a 16x8 grid (Standard ASCII layout)
-	const int w = GetGlyphWidth(c);
-	const int h = GetGlyphHeight(c);
-	MD_Rect src = { (c % 16) * m_GlyphSurfaceW, (c / 16) * m_GlyphSurfaceH, w, h };
-	if (!m_Monospace)
+	int count = 0;
+	for (int i = 0; i < m_Count; ++i)
 	{
-		src.x += m_GlyphData[c].left;
+		count += RectArea(m_Rects[i]);
 	}
-	return src;
+	return count;
 }
 
-void Font::MakeVariableWidth()
+bool md_clip_blit(int imageW, int imageH, const MD_Rect& clip, MD_Rect& src, MD_Rect& dst)
 {
-	for (int i = 0; i < 256; ++i)
+	// Clip the source to the image, moving the destination along with it
+	MD_Rect clippedSrc;
+	if (!md_intersect_rect(src, MD_Rect{ 0, 0, imageW, imageH }, clippedSrc))
+	{
+		return false;
+	}
+	dst.x += clippedSrc.x - src.x;
+	dst.y += clippedSrc.y - src.y;
+	dst.w = clippedSrc.w;
+	dst.h = clippedSrc.h;
+
+	// Then the destination to the clip rect, moving the source along with it
+	MD_Rect clippedDst;
+	if (!md_intersect_rect(dst, clip, clippedDst))
 	{
-		const char c = (char)i;
-		const int w = m_GlyphSurfaceW;
-		const int h = m_GlyphSurfaceH;
-		const MD_Rect src = GetGlpyphRect(c);
+		return false;
+	}
+	src.x = clippedSrc.x + (clippedDst.x - dst.x);
+	src.y = clippedSrc.y + (clippedDst.y - dst.y);
+	src.w = clippedDst.w;
+	src.h = clippedDst.h;
+	dst = clippedDst;
+	return true;
+}
 
-		// Get where the font pixel data starts and stops along the X axis, and set the character width to match
-		GlyphData& glyphData = m_GlyphData[i];
-		md_get_pixel_x_bounds(*m_Surface, src, glyphData.left, glyphData.right);
-		//GetPixelXBounds(m_Surface, src, glyphData.left, glyphData.right);
-		glyphData.width = (glyphData.right - glyphData.left) + 1;
+bool md_clip_scaled_source(int imageW, int imageH, MD_Rect& src, MD_Rect& dst)
+{
+	MD_Rect clippedSrc;
+	if (!md_intersect_rect(src, MD_Rect{ 0, 0, imageW, imageH }, clippedSrc))
+	{
+		return false;
+	}
+	if (clippedSrc.w == src.w && clippedSrc.h == src.h)
+	{
+		return true;
+	}
 
-		// For fully empty characters
-		if (glyphData.width <= 0)
-		{
-			glyphData.width = w / 2;
-		}
+	// Keep the scale and pull in the destination edges by the scaled amount that was cut off
+	const double scaleX = (double)dst.w / src.w;
+	const double scaleY = (double)dst.h / src.h;
+	const double dstX0 = dst.x + (clippedSrc.x - src.x) * scaleX;
+	const double dstY0 = dst.y + (clippedSrc.y - src.y) * scaleY;
+	const double dstX1 = dst.x + dst.w - ((src.x + src.w) - (clippedSrc.x + clippedSrc.w)) * scaleX;
+	const double dstY1 = dst.y + dst.h - ((src.y + src.h) - (clippedSrc.y + clippedSrc.h)) * scaleY;
+	dst.x = (int)std::floor(dstX0 + 0.5);
+	dst.y = (int)std::floor(dstY0 + 0.5);
+	dst.w = (int)std::floor(dstX1 - dstX0 + 0.5);
+	dst.h = (int)std::floor(dstY1 - dstY0 + 0.5);
+	src = clippedSrc;
+	return dst.w > 0 && dst.h > 0;
+}
 
-	}
+static bool RectContains(const MD_Rect& outer, const MD_Rect& inner)
+{
+	return inner.x >= outer.x && inner.y >= outer.y &&
+		inner.x + inner.w <= outer.x + outer.w &&
+		inner.y + inner.h <= outer.y + outer.h;
+}
 
-	m_Monospace = false;
-	m_SpacingX = 1;
+static bool RectsOverlap(const MD_Rect& a, const MD_Rect& b)
+{
+	return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
 }
 
-// Draw text using an 8x8 bitmap font sheet
-void draw_text(Font& font, int x, int y, const char* text, int scale)
+// How many recent opaque commands to test each command against when culling
+const int MD_MAX_OCCLUDERS = 16;
+
+// Grid cell size used to find overlapping commands
+const int MD_DRAW_TILE_SIZE = 32;
+
+void DrawCommandList::Add(const MD_DrawCommand& command)
 {
-	MD_Rect dst = { x, y, 0, 0 };
-	for (int i = 0; text[i] != '\0'; i++)
+	if (command.bounds.w <= 0 || command.bounds.h <= 0)
 	{
-		int ascii = (unsigned char)text[i] - 1;
-		MD_Rect src = font.GetGlpyphRect(ascii);
-		dst.w = src.w * scale;
-		dst.h = src.h * scale;
-		//SDL_Rect src = { (ascii % 16) * 8, (ascii / 16) * 8, 8, 8 };
-		//SDL_Rect dst = { x + (i * 8 * scale), y, 8 * scale, 8 * scale };
-		md_draw_image_scaled(*font.m_Surface, src, dst);
-		dst.x += src.w * scale;
-		dst.x += font.m_SpacingX * scale;
+		return;
 	}
+	m_Commands.push_back(command);
+	m_Commands.back().order = (uint32_t)m_Commands.size() - 1;
 }
 
-void draw_num(Font& font, int x, int y, const char* text, int scale)
+void DrawCommandList::Clear()
 {
-	const int glyph_width = font.m_GlyphSurfaceW;
-	const int glyph_height = font.m_GlyphSurfaceH;
-	int space_x = 2;
+	// Keeps the capacity, so recording doesn't allocate after the first few frames
+	m_Commands.clear();
+	m_NumCulled = 0;
+}
 
-	for (int i = 0; text[i] != '\0'; i++)
+void DrawCommandList::Prepare()
+{
+	// Walk backwards keeping the opaque areas drawn later on. Anything entirely inside
+	// one of them would just be drawn over.
+	MD_Rect occluders[MD_MAX_OCCLUDERS];
+	int numOccluders = 0;
+	size_t kept = m_Commands.size();
+	for (size_t i = m_Commands.size(); i-- > 0;)
 	{
-		int ascii = (unsigned char)text[i] - 1;
-		if (ascii < 47 || ascii > 56)
+		const MD_DrawCommand& command = m_Commands[i];
+		bool hidden = false;
+		for (int o = 0; o < numOccluders && !hidden; ++o)
 		{
+			hidden = RectContains(occluders[o], command.bounds);
+		}
+
+		if (hidden)
+		{
+			m_Commands[i].type = 0xFF;
+			--kept;
 			continue;
 		}
-		ascii -= 47;
 
-		// Calculate position in a 16x8 grid (Standard ASCII layout)
-		int xIdx = ascii % 5;
-		int yIdx = ascii / 5;
-		MD_Rect src = { xIdx * glyph_width, yIdx * glyph_height, glyph_width, glyph_height };
-		MD_Rect dst = { x + (i * (glyph_width + space_x) * scale), y, glyph_width * scale, glyph_height * scale };
-		md_draw_image_scaled(*font.m_Surface, src, dst);
-		//int res = SDL_BlitSurfaceScaled(font.m_Surface, &src, dest, &dst, SDL_SCALEMODE_NEAREST);
-		//if (res != 0)
-		//{
-		//    const char* err = SDL_GetError();
-		//}
+		if (command.opaque)
+		{
+			if (numOccluders < MD_MAX_OCCLUDERS)
+			{
+				occluders[numOccluders++] = command.bounds;
+			}
+			else
+			{
+				// Replace the smallest, big areas hide the most
+				int smallest = 0;
+				for (int o = 1; o < numOccluders; ++o)
+				{
+					if (RectArea(occluders[o]) < RectArea(occluders[smallest]))
+					{
+						smallest = o;
+					}
+				}
+				if (RectArea(command.bounds) > RectArea(occluders[smallest]))
+				{
+					occluders[smallest] = command.bounds;
+				}
+			}
+		}
 	}
-}
 
+	m_NumCulled = (int)(m_Commands.size() - kept);
+	m_Commands.erase(std::remove_if(m_Commands.begin(), m_Commands.end(),
+		[](const MD_DrawCommand& command) { return command.type == 0xFF; }), m_Commands.end());
 
+	// A command's layer is one above the highest earlier command it overlaps. Commands on
+	// the same layer never overlap each other, so can run in any order.
+	// Earlier commands are found through a coarse grid so each only gets tested against
+	// its neighbours rather than the whole frame.
+	if (m_Commands.empty())
+	{
+		return;
+	}
+	MD_Rect extent = m_Commands[0].bounds;
+	for (const MD_DrawCommand& command : m_Commands)
+	{
+		extent = md_union_rect(extent, command.bounds);
+	}
+	const int tilesX = (extent.w + MD_DRAW_TILE_SIZE - 1) / MD_DRAW_TILE_SIZE;
+	const int tilesY = (extent.h + MD_DRAW_TILE_SIZE - 1) / MD_DRAW_TILE_SIZE;
+	if ((int)m_Tiles.size() < tilesX * tilesY)
+	{
+		m_Tiles.resize(tilesX * tilesY);
+	}
+	for (int t = 0; t < tilesX * tilesY; ++t)
+	{
+		m_Tiles[t].clear();
+	}
 
+	for (size_t i = 0; i < m_Commands.size(); ++i)
+	{
+		MD_DrawCommand& command = m_Commands[i];
+		const int tx0 = (command.bounds.x - extent.x) / MD_DRAW_TILE_SIZE;
+		const int ty0 = (command.bounds.y - extent.y) / MD_DRAW_TILE_SIZE;
+		const int tx1 = (command.bounds.x + command.bounds.w - 1 - extent.x) / MD_DRAW_TILE_SIZE;
+		const int ty1 = (command.bounds.y + command.bounds.h - 1 - extent.y) / MD_DRAW_TILE_SIZE;
+
+		command.layer = 0;
+		for (int ty = ty0; ty <= ty1; ++ty)
+		{
+			for (int tx = tx0; tx <= tx1; ++tx)
+			{
+				std::vector<uint32_t>& tile = m_Tiles[(ty * tilesX) + tx];
+				for (uint32_t j : tile)
+				{
+					const MD_DrawCommand& earlier = m_Commands[j];
+					if (earlier.layer >= command.layer && RectsOverlap(earlier.bounds, command.bounds))
+					{
+						command.layer = earlier.layer + 1;
+					}
+				}
+				tile.push_back((uint32_t)i);
+			}
+		}
+	}
 
-void PanningImage::InitPanningImage(const char* file, int x, int y, int w, int h)
+	std::sort(m_Commands.begin(), m_Commands.end(), [](const MD_DrawCommand& a, const MD_DrawCommand& b)
+	{
+		if (a.layer != b.layer) return a.layer < b.layer;
+		if (a.image != b.image) return a.image < b.image;
+		if (a.type != b.type) return a.type < b.type;
+		const uint32_t stateA = (a.r << 16) | (a.g << 8) | a.b;
+		const uint32_t stateB = (b.r << 16) | (b.g << 8) | b.b;
+		if (stateA != stateB) return stateA < stateB;
+		if (a.clip.x != b.clip.x) return a.clip.x < b.clip.x;
+		if (a.clip.y != b.clip.y) return a.clip.y < b.clip.y;
+		if (a.clip.w != b.clip.w) return a.clip.w < b.clip.w;
+		if (a.clip.h != b.clip.h) return a.clip.h < b.clip.h;
+		return a.order < b.order;
+	});
+}
+
+int64_t md_time_ns()
 {
-	m_Image = md_load_image_with_key(file, 0, 0, 0);
-	m_Rect.x = x;
-	m_Rect.y = y;
-	m_Rect.w = w;
-	m_Rect.h = h;
+#ifdef __linux__
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((int64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
 }
 
-void PanningImage::UpdateAndDrawPanningImage()
+static void SleepUntilNs(int64_t deadline)
 {
-	md_set_clip(m_Rect);
-	MD_Rect scrolled = m_Rect;
-	if (m_panHorizontal)
+#ifdef __linux__
+	timespec when;
+	when.tv_sec = (time_t)(deadline / 1000000000);
+	when.tv_nsec = (long)(deadline % 1000000000);
+	// Absolute deadline, so being woken early by a signal just carries on sleeping
+	int result;
+	do
 	{
-		scrolled.x += (int)m_Scroll;
+		result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, nullptr);
+	} while (result == EINTR);
+	if (result == 0)
+	{
+		return;
 	}
-	else
+	// Any other error won't go away by retrying, so sleep the relative way instead
+#endif
+	const int64_t remaining = deadline - md_time_ns();
+	if (remaining > 0)
 	{
-		scrolled.y += (int)m_Scroll;
+		std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
 	}
-	m_Scroll = m_Scroll + m_Speed;
-	md_draw_image(*m_Image, scrolled.x, scrolled.y);
-	//SDL_BlitSurface(m_Image, NULL, dest, &scrolled);
-	if (m_panHorizontal)
+}
+
+class FrameScheduler
+{
+public:
+	void PaceFrame(bool idle);
+
+	MD_FrameTiming m_Timing;
+	int64_t m_FrameStart = 0;
+	int64_t m_NextDeadline = 0;
+	double m_TotalFrameMs = 0.0;
+};
+
+static FrameScheduler frameScheduler;
+
+void FrameScheduler::PaceFrame(bool idle)
+{
+	const int64_t now = md_time_ns();
+	if (m_FrameStart == 0)
 	{
-		const int w = md_get_image_width(*m_Image);
-		scrolled.x -= w;
-		if (m_Scroll > w)
-		{
-			m_Scroll -= w;
-		}
+		// First frame, nothing to measure against yet
+		m_FrameStart = now;
+		m_NextDeadline = now;
 	}
-	else
+
+	MD_FrameTiming& timing = m_Timing;
+	const float frameMs = (float)(now - m_FrameStart) / 1e6f;
+	timing.last_frame_ms = frameMs;
+	timing.min_frame_ms = timing.frame_count == 0 ? frameMs : std::min(timing.min_frame_ms, frameMs);
+	timing.max_frame_ms = std::max(timing.max_frame_ms, frameMs);
+	m_TotalFrameMs += frameMs;
+	timing.frame_count++;
+	timing.avg_frame_ms = (float)(m_TotalFrameMs / (double)timing.frame_count);
+	timing.idle = idle && timing.idle_fps > 0;
+
+	const int fps = timing.idle ? timing.idle_fps : timing.target_fps;
+	if (fps > 0)
 	{
-		const int h = md_get_image_height(*m_Image);
-		scrolled.y -= h;
-		if (m_Scroll > h)
+		m_NextDeadline += 1000000000 / fps;
+
+		// If we've fallen more than a frame behind, don't rush to catch up
+		if (m_NextDeadline < now)
 		{
-			m_Scroll -= h;
+			m_NextDeadline = now;
 		}
+		SleepUntilNs(m_NextDeadline);
 	}
-	//SDL_BlitSurface(m_Image, NULL, dest, &scrolled);
-	md_draw_image(*m_Image, scrolled.x, scrolled.y);
 
-	md_clear_clip();
+	const int64_t nextStart = md_time_ns();
+	timing.last_interval_ms = (float)(nextStart - m_FrameStart) / 1e6f;
+	m_FrameStart = nextStart;
+	if (fps <= 0)
+	{
+		m_NextDeadline = nextStart;
+	}
 }
 
+void md_set_target_fps(int fps)
+{
+	frameScheduler.m_Timing.target_fps = std::max(0, fps);
+}
 
+void md_set_idle_fps(int fps)
+{
+	frameScheduler.m_Timing.idle_fps = std::max(0, fps);
+}
 
-void FlipBookImage::InitFlipbook(const char* bmpName, int numCols, int numRows, int x, int y)
+MD_FrameTiming md_get_frame_timing()
 {
-	m_Image = md_load_image(bmpName);
-	m_Width = md_get_image_width(*m_Image) / numCols;
-	m_Height = md_get_image_height(*m_Image) / numRows;
-	m_Cols = numCols;
-	m_Rows = numRows;
-	m_X = x;
-	m_Y = y;
+	return frameScheduler.m_Timing;
 }
 
-void FlipBookImage::UpdateFlipbook()
+void md_reset_frame_timing()
 {
-	const int sourceIdxX = (m_Frame % m_Cols);
-	const int sourceIdxY = (m_Frame / m_Cols);
-	m_Frame = (m_Frame + 1) % (m_Cols * m_Rows);
-	MD_Rect sourceRect = { sourceIdxX * m_Width, sourceIdxY * m_Height, m_Width, m_Height };
-	MD_Rect destRect = { m_X, m_Y, m_Width, m_Height };
-	md_draw_image(*m_Image, sourceRect, destRect);
-	//SDL_BlitSurface(m_Image, &sourceRect, dest, &destRect);
+	MD_FrameTiming& timing = frameScheduler.m_Timing;
+	const int targetFps = timing.target_fps;
+	const int idleFps = timing.idle_fps;
+	timing = MD_FrameTiming();
+	timing.target_fps = targetFps;
+	timing.idle_fps = idleFps;
+	frameScheduler.m_TotalFrameMs = 0.0;
+}
+
+void md_pace_frame(bool idle)
+{
+	frameScheduler.PaceFrame(idle);
+}
+
+#ifdef MD_PROFILING
+// Written from both the app and present threads
+struct AtomicStatCounter
+{
+	std::atomic<uint32_t> calls{ 0 };
+	std::atomic<uint64_t> pixels{ 0 };
+	std::atomic<uint64_t> ns{ 0 };
+};
+
+static AtomicStatCounter currentFrameStats[MD_STAT_COUNT];
+static MD_FrameStats lastFrameStats;
+
+void md_add_stat(MD_StatId id, uint32_t calls, uint64_t pixels, uint64_t ns)
+{
+	AtomicStatCounter& counter = currentFrameStats[id];
+	counter.calls.fetch_add(calls, std::memory_order_relaxed);
+	counter.pixels.fetch_add(pixels, std::memory_order_relaxed);
+	counter.ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+void md_end_frame_stats()
+{
+	for (int i = 0; i < MD_STAT_COUNT; ++i)
+	{
+		AtomicStatCounter& counter = currentFrameStats[i];
+		MD_StatCounter& last = lastFrameStats.counters[i];
+		last.calls = counter.calls.exchange(0, std::memory_order_relaxed);
+		last.pixels = counter.pixels.exchange(0, std::memory_order_relaxed);
+		last.ns = counter.ns.exchange(0, std::memory_order_relaxed);
+	}
+	lastFrameStats.frame++;
+}
+
+MD_FrameStats md_get_frame_stats()
+{
+	return lastFrameStats;
+}
+
+void md_draw_frame_stats(Font& font, int x, int y)
+{
+	const MD_FrameStats stats = md_get_frame_stats();
+	char line[64];
+	for (int i = 0; i < MD_STAT_COUNT; ++i)
+	{
+		const MD_StatCounter& counter = stats.counters[i];
+		snprintf(line, sizeof(line), "%-11s %4u %6.2fms %6uk", md_get_stat_name((MD_StatId)i),
+			counter.calls, (double)counter.ns / 1e6, (unsigned int)(counter.pixels / 1000));
+		draw_text(font, x, y, line, 1);
+		y += font.m_GlyphSurfaceH;
+	}
+}
+#endif
+
+const char* md_get_stat_name(MD_StatId id)
+{
+	switch (id)
+	{
+	case MD_STAT_DRAW_IMAGE:        return "draw_image";
+	case MD_STAT_DRAW_IMAGE_SCALED: return "draw_scaled";
+	case MD_STAT_FILLED_RECT:       return "filled_rect";
+	case MD_STAT_DRAW_GLYPH:        return "draw_glyph";
+	case MD_STAT_FLUSH_DRAWS:       return "flush_draws";
+	case MD_STAT_BLIT_TO_FB:        return "blit_to_fb";
+	case MD_STAT_UPDATE_TEXTURE:    return "update_tex";
+	case MD_STAT_PARSE_JSON_FILE:   return "parse_json";
+	case MD_STAT_LOAD_CONFIG:       return "load_config";
+	default:                        return "unknown";
+	}
+}
+
+static std::string ReplaceExtension(const char* filename, const char* extension)
+{
+	std::string name = filename;
+	const size_t dot = name.rfind('.');
+	const size_t slash = name.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+	{
+		name.erase(dot);
+	}
+	return name + extension;
+}
+
+void Font::InitFont(const char* bmpName, int glyphWidth, int glyphHeight)
+{
+	m_GlyphSurfaceW = glyphWidth;
+	m_GlyphSurfaceH = glyphHeight;
+	m_Surface = md_load_image_with_key(bmpName, 0, 0, 0);
+	BuildGlyphMask();
+	BuildMetrics();
+
+	// Extra glyphs and kerning live next to the sheet, font.bmp -> font.glyphs
+	LoadGlyphMap(ReplaceExtension(bmpName, ".glyphs").c_str());
 }
 
+void Font::InitFontFromImageData(const char* data, int w, int h, int glyphWidth, int glyphHeight)
+{
+	m_GlyphSurfaceW = glyphWidth;
+	m_GlyphSurfaceH = glyphHeight;
+	m_Surface = md_load_image_from_565_data_with_key(data, w, h, 0, 0, 0);
+	BuildGlyphMask();
+	BuildMetrics();
+	m_ExtraGlyphs.clear();
+	m_Kerning.clear();
+}
 
+void Font::BuildGlyphMask()
+{
+	m_GlyphMask.clear();
+	MD_PixelBuffer sheet;
+	if (!m_Surface || !md_get_image_pixels(*m_Surface, sheet))
+	{
+		return;
+	}
 
+	std::vector<uint8_t> mask((size_t)sheet.w * sheet.h, 0);
+	bool foundInk = false;
+	uint32_t ink = 0;
+	for (int y = 0; y < sheet.h; ++y)
+	{
+		const uint8_t* row = sheet.pixels + ((size_t)y * sheet.pitch);
+		for (int x = 0; x < sheet.w; ++x)
+		{
+			// Black is the font's colour key
+			const uint32_t pixel = sheet.rgb565 ? ((const uint16_t*)row)[x] : (((const uint32_t*)row)[x] & 0x00FFFFFF);
+			if (pixel == 0)
+			{
+				continue;
+			}
+			if (foundInk && pixel != ink)
+			{
+				// More than one colour, so glyphs have to be blitted to keep them
+				return;
+			}
+			foundInk = true;
+			ink = pixel;
+			mask[((size_t)y * sheet.w) + x] = 255;
+		}
+	}
 
+	if (sheet.rgb565)
+	{
+		const uint32_t r = (ink >> 11) & 0x1F;
+		const uint32_t g = (ink >> 5) & 0x3F;
+		const uint32_t b = ink & 0x1F;
+		m_GlyphInk = { (uint8_t)((r << 3) | (r >> 2)), (uint8_t)((g << 2) | (g >> 4)), (uint8_t)((b << 3) | (b >> 2)), 255 };
+	}
+	else
+	{
+		m_GlyphInk = { (uint8_t)(ink >> 16), (uint8_t)(ink >> 8), (uint8_t)ink, 255 };
+	}
+	m_GlyphMask.swap(mask);
+	m_GlyphMaskW = sheet.w;
+	m_GlyphMaskH = sheet.h;
+}
 
+// Write ink wherever the mask is lit. SCALE is known at compile time for the common
+// sizes so the divides become shifts, 0 falls back to the runtime scale.
+template <typename Pixel, int SCALE>
+static void RasteriseGlyph(const MD_PixelBuffer& target, const Font& font, const MD_Rect& src, const MD_Rect& dst, const MD_Rect& area, int runtimeScale, Pixel ink)
+{
+	const int scale = SCALE > 0 ? SCALE : runtimeScale;
+	for (int y = area.y; y < area.y + area.h; ++y)
+	{
+		const int maskY = src.y + ((y - dst.y) / scale);
+		const uint8_t* maskRow = font.m_GlyphMask.data() + ((size_t)maskY * font.m_GlyphMaskW) + src.x;
+		Pixel* out = (Pixel*)(target.pixels + ((size_t)y * target.pitch));
+		for (int x = area.x; x < area.x + area.w; ++x)
+		{
+			if (maskRow[(x - dst.x) / scale])
+			{
+				out[x] = ink;
+			}
+		}
+	}
+}
 
+template <typename Pixel>
+static void RasteriseGlyphScaled(const MD_PixelBuffer& target, const Font& font, const MD_Rect& src, const MD_Rect& dst, const MD_Rect& area, int scale, Pixel ink)
+{
+	switch (scale)
+	{
+	case 1: RasteriseGlyph<Pixel, 1>(target, font, src, dst, area, scale, ink); break;
+	case 2: RasteriseGlyph<Pixel, 2>(target, font, src, dst, area, scale, ink); break;
+	case 3: RasteriseGlyph<Pixel, 3>(target, font, src, dst, area, scale, ink); break;
+	case 4: RasteriseGlyph<Pixel, 4>(target, font, src, dst, area, scale, ink); break;
+	default: RasteriseGlyph<Pixel, 0>(target, font, src, dst, area, scale, ink); break;
+	}
+}
 
+void md_rasterise_glyph(const MD_PixelBuffer& target, const Font& font, const MD_Rect& src, const MD_Rect& dst, uint8_t r, uint8_t g, uint8_t b)
+{
+	if (src.w <= 0 || src.h <= 0)
+	{
+		return;
+	}
+	const int scale = std::max(1, dst.w / src.w);
+
+	// Glyphs off the edge of the sheet only draw the part that's on it, like a blit would
+	MD_Rect sheetSrc;
+	if (!md_intersect_rect(src, MD_Rect{ 0, 0, font.m_GlyphMaskW, font.m_GlyphMaskH }, sheetSrc))
+	{
+		return;
+	}
+	const MD_Rect sheetDst = {
+		dst.x + ((sheetSrc.x - src.x) * scale),
+		dst.y + ((sheetSrc.y - src.y) * scale),
+		sheetSrc.w * scale,
+		sheetSrc.h * scale };
+
+	MD_Rect area;
+	if (!md_intersect_rect(sheetDst, target.clip, area))
+	{
+		return;
+	}
+
+	// Same as a colour modded blit of the glyph
+	const uint32_t inkR = (font.m_GlyphInk.r * r) / 255;
+	const uint32_t inkG = (font.m_GlyphInk.g * g) / 255;
+	const uint32_t inkB = (font.m_GlyphInk.b * b) / 255;
+	if (target.rgb565)
+	{
+		const uint16_t ink = (uint16_t)(((inkR >> 3) << 11) | ((inkG >> 2) << 5) | (inkB >> 3));
+		RasteriseGlyphScaled<uint16_t>(target, font, sheetSrc, sheetDst, area, scale, ink);
+	}
+	else
+	{
+		const uint32_t ink = (inkR << 16) | (inkG << 8) | inkB;
+		RasteriseGlyphScaled<uint32_t>(target, font, sheetSrc, sheetDst, area, scale, ink);
+	}
+}
+
+int Font::GetGlyphWidth(char c) const
+{
+	if (m_Monospace)
+	{
+		return m_GlyphSurfaceW;
+	}
+
+	return m_GlyphData[(unsigned char)c].width;
+}
+
+int Font::GetGlyphHeight(char c) const
+{
+	return m_GlyphSurfaceH;
+}
+
+MD_Rect Font::GetGlpyphRect(char c) const
+{
+	// Calculate position in a 16x8 grid (Standard ASCII layout)
+	const int cell = (unsigned char)c;
+	const int w = GetGlyphWidth(c);
+	const int h = GetGlyphHeight(c);
+	MD_Rect src = { (cell % 16) * m_GlyphSurfaceW, (cell / 16) * m_GlyphSurfaceH, w, h };
+	if (!m_Monospace)
+	{
+		src.x += m_GlyphData[cell].left;
+	}
+	return src;
+}
+
+void Font::BuildMetrics()
+{
+	m_Glyphs.clear();
+	if (m_Surface)
+	{
+		// m_GlyphData only covers 256 cells
+		const int rows = md_get_image_height(*m_Surface) / m_GlyphSurfaceH;
+		const int numCells = std::min(256, 16 * rows);
+		for (int cell = 0; cell < numCells; ++cell)
+		{
+			GlyphMetrics metrics;
+			metrics.src = GetGlpyphRect((char)cell);
+			if (!m_Monospace && m_GlyphData[cell].right < m_GlyphData[cell].left)
+			{
+				// Nothing drawn in this cell, so there's no bearing to skip
+				metrics.src.x = (cell % 16) * m_GlyphSurfaceW;
+			}
+			metrics.advance = metrics.src.w;
+			m_Glyphs.push_back(metrics);
+		}
+	}
+
+	for (uint32_t codepoint = 0; codepoint < 128; ++codepoint)
+	{
+		const int cell = (int)codepoint - (int)FIRST_CODEPOINT;
+		m_AsciiGlyphs[codepoint] = (cell >= 0 && cell < (int)m_Glyphs.size()) ? (int16_t)cell : -1;
+	}
+}
+
+bool Font::LoadGlyphMap(const char* filename)
+{
+	// Lines are either
+	//   U+00E9=131     codepoint in hex = sheet cell holding its glyph
+	//   kern AV=-1     pair of characters = extra pixels between them
+	// A font reloaded without a map keeps none from before
+	m_ExtraGlyphs.clear();
+	m_Kerning.clear();
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::vector<std::pair<std::string, int>> kernPairs;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const size_t delimiterPos = line.rfind('=');
+		if (line.empty() || line[0] == '#' || delimiterPos == std::string::npos)
+		{
+			continue;
+		}
+		const int value = atoi(line.c_str() + delimiterPos + 1);
+
+		if (line.compare(0, 2, "U+") == 0)
+		{
+			const uint32_t codepoint = (uint32_t)strtoul(line.c_str() + 2, nullptr, 16);
+			if (value < 0 || value >= (int)m_Glyphs.size())
+			{
+				continue;
+			}
+			auto existing = std::find_if(m_ExtraGlyphs.begin(), m_ExtraGlyphs.end(),
+				[codepoint](const std::pair<uint32_t, uint16_t>& entry) { return entry.first == codepoint; });
+			if (existing != m_ExtraGlyphs.end())
+			{
+				existing->second = (uint16_t)value;
+			}
+			else
+			{
+				m_ExtraGlyphs.emplace_back(codepoint, (uint16_t)value);
+			}
+		}
+		else if (line.compare(0, 5, "kern ") == 0)
+		{
+			kernPairs.emplace_back(line.substr(5, delimiterPos - 5), value);
+		}
+	}
+
+	// Kern pairs can name U+ glyphs from anywhere in the file, so they're only looked up
+	// once every glyph is in and sorted for FindGlyph
+	std::sort(m_ExtraGlyphs.begin(), m_ExtraGlyphs.end());
+	for (const std::pair<std::string, int>& kernPair : kernPairs)
+	{
+		const char* cursor = kernPair.first.c_str();
+		const int left = FindGlyph(md_decode_utf8(cursor));
+		const int right = *cursor != '\0' ? FindGlyph(md_decode_utf8(cursor)) : -1;
+		if (left >= 0 && right >= 0)
+		{
+			m_Kerning.emplace_back(((uint32_t)left << 16) | (uint32_t)right, (int8_t)kernPair.second);
+		}
+	}
+	std::sort(m_Kerning.begin(), m_Kerning.end());
+	return true;
+}
+
+// Plain ASCII stand-in for Latin-1 letters, so accented text still reads without extra glyphs
+static const char latin1Fallback[] =
+	"AAAAAAACEEEEIIII"  // U+00C0
+	"DNOOOOOxOUUUUYPs"  // U+00D0
+	"aaaaaaaceeeeiiii"  // U+00E0
+	"dnooooo/ouuuuypy"; // U+00F0
+
+static uint32_t FallbackCodepoint(uint32_t codepoint)
+{
+	if (codepoint >= 0xC0 && codepoint <= 0xFF)
+	{
+		return (uint8_t)latin1Fallback[codepoint - 0xC0];
+	}
+
+	switch (codepoint)
+	{
+	case 0xA0: return ' ';      // No-break space
+	case 0x2013:                // En dash
+	case 0x2014: return '-';    // Em dash
+	case 0x2018:
+	case 0x2019: return '\'';
+	case 0x201C:
+	case 0x201D: return '"';
+	case 0x2026: return '.';    // Ellipsis
+	default: return 0;
+	}
+}
+
+int Font::FindGlyph(uint32_t codepoint) const
+{
+	int glyph = -1;
+	if (codepoint < 128)
+	{
+		glyph = m_AsciiGlyphs[codepoint];
+	}
+	else
+	{
+		auto found = std::lower_bound(m_ExtraGlyphs.begin(), m_ExtraGlyphs.end(), codepoint,
+			[](const std::pair<uint32_t, uint16_t>& entry, uint32_t value) { return entry.first < value; });
+		if (found != m_ExtraGlyphs.end() && found->first == codepoint)
+		{
+			glyph = found->second;
+		}
+		else
+		{
+			const uint32_t fallback = FallbackCodepoint(codepoint);
+			glyph = fallback != 0 ? m_AsciiGlyphs[fallback] : -1;
+		}
+	}
+	return glyph < (int)m_Glyphs.size() ? glyph : -1;
+}
+
+int Font::GetKerning(int leftGlyph, int rightGlyph) const
+{
+	if (m_Kerning.empty())
+	{
+		return 0;
+	}
+
+	const uint32_t key = ((uint32_t)leftGlyph << 16) | (uint32_t)rightGlyph;
+	auto found = std::lower_bound(m_Kerning.begin(), m_Kerning.end(), key,
+		[](const std::pair<uint32_t, int8_t>& entry, uint32_t value) { return entry.first < value; });
+	return (found != m_Kerning.end() && found->first == key) ? found->second : 0;
+}
+
+uint32_t md_decode_utf8(const char*& text)
+{
+	const uint8_t* bytes = (const uint8_t*)text;
+	const uint8_t lead = bytes[0];
+	if (lead < 0x80)
+	{
+		text += 1;
+		return lead;
+	}
+
+	int length = 0;
+	uint32_t codepoint = 0;
+	if ((lead & 0xE0) == 0xC0)
+	{
+		length = 2;
+		codepoint = lead & 0x1F;
+	}
+	else if ((lead & 0xF0) == 0xE0)
+	{
+		length = 3;
+		codepoint = lead & 0x0F;
+	}
+	else if ((lead & 0xF8) == 0xF0)
+	{
+		length = 4;
+		codepoint = lead & 0x07;
+	}
+
+	// Stops at the terminator too, as it isn't a continuation byte
+	for (int i = 1; i < length; ++i)
+	{
+		if ((bytes[i] & 0xC0) != 0x80)
+		{
+			length = 0;
+			break;
+		}
+		codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+	}
+
+	static const uint32_t smallestForLength[] = { 0, 0, 0x80, 0x800, 0x10000 };
+	if (length == 0 || codepoint < smallestForLength[length] || codepoint > 0x10FFFF)
+	{
+		text += 1;
+		return lead;
+	}
+	text += length;
+	return codepoint;
+}
+
+// Step through the glyphs of a line of text, calling func with each glyph's metrics and
+// its x offset from the start. Returns the total width.
+template <typename Func>
+static int ForEachGlyph(const Font& font, const char* text, int scale, Func&& func)
+{
+	int penX = 0;
+	int previous = -1;
+	const char* cursor = text;
+	while (*cursor != '\0')
+	{
+		const int glyph = font.FindGlyph(md_decode_utf8(cursor));
+		if (glyph < 0)
+		{
+			continue;
+		}
+		if (previous >= 0)
+		{
+			penX += font.GetKerning(previous, glyph) * scale;
+		}
+
+		const Font::GlyphMetrics& metrics = font.m_Glyphs[glyph];
+		func(metrics, penX);
+		penX += (metrics.advance + font.m_SpacingX) * scale;
+		previous = glyph;
+	}
+	return penX;
+}
+
+int Font::GetTextWidth(const char* text, int scale) const
+{
+	return ForEachGlyph(*this, text, scale, [](const GlyphMetrics&, int) {});
+}
+
+void Font::MakeVariableWidth()
+{
+	ScanGlyphBounds();
+	m_Monospace = false;
+	m_SpacingX = 1;
+	BuildMetrics();
+}
+
+void Font::ScanGlyphBounds()
+{
+	const int w = m_GlyphSurfaceW;
+	const int h = m_GlyphSurfaceH;
+
+	MD_PixelBuffer sheet;
+	if (!md_get_image_pixels(*m_Surface, sheet))
+	{
+		// Not a format we can read directly, so ask the backend glyph by glyph
+		for (int i = 0; i < 256; ++i)
+		{
+			const MD_Rect src = { (i % 16) * w, (i / 16) * h, w, h };
+			GlyphData& glyphData = m_GlyphData[i];
+			md_get_pixel_x_bounds(*m_Surface, src, glyphData.left, glyphData.right);
+			glyphData.width = (glyphData.right - glyphData.left) + 1;
+			if (glyphData.width <= 0)
+			{
+				glyphData.width = w / 2;
+			}
+		}
+	}
+	else
+	{
+		// One pass down the sheet a row of cells at a time. ORing the rows of each band
+		// together leaves a non-zero column wherever any glyph in that band has a pixel.
+		const int bytesPerPixel = sheet.rgb565 ? 2 : 4;
+		const int bandW = std::min(sheet.w, 16 * w);
+		std::vector<uint8_t> columns((size_t)bandW * bytesPerPixel);
+		for (int cellRow = 0; cellRow < 16; ++cellRow)
+		{
+			std::fill(columns.begin(), columns.end(), (uint8_t)0);
+			const int endY = std::min(sheet.h, (cellRow + 1) * h);
+			for (int y = cellRow * h; y < endY; ++y)
+			{
+				md_or_accumulate(columns.data(), sheet.pixels + ((size_t)y * sheet.pitch), (int)columns.size());
+			}
+
+			for (int cellCol = 0; cellCol < 16; ++cellCol)
+			{
+				// Get where the font pixel data starts and stops along the X axis, and set the character width to match
+				GlyphData& glyphData = m_GlyphData[(cellRow * 16) + cellCol];
+				glyphData.left = w;
+				glyphData.right = 0;
+				for (int x = 0; x < w; ++x)
+				{
+					const int sheetX = (cellCol * w) + x;
+					if (sheetX >= bandW)
+					{
+						break;
+					}
+
+					// Ignore the unused top byte of XRGB8888
+					const uint8_t* column = columns.data() + ((size_t)sheetX * bytesPerPixel);
+					const bool lit = sheet.rgb565 ? (column[0] | column[1]) != 0 : (column[0] | column[1] | column[2]) != 0;
+					if (lit)
+					{
+						glyphData.left = std::min(glyphData.left, x);
+						glyphData.right = x;
+					}
+				}
+				glyphData.width = (glyphData.right - glyphData.left) + 1;
+
+				// For fully empty characters
+				if (glyphData.width <= 0)
+				{
+					glyphData.width = w / 2;
+				}
+			}
+		}
+	}
+}
+
+// Draw each glyph of text into dest, or the canvas when dest is null
+static void DrawGlyphs(Font& font, MD_Image* dest, int x, int y, const char* text, int scale)
+{
+	ForEachGlyph(font, text, scale, [&](const Font::GlyphMetrics& metrics, int penX)
+	{
+		MD_Rect src = metrics.src;
+		MD_Rect dst = { x + penX, y, src.w * scale, src.h * scale };
+		if (dest == nullptr && font.HasGlyphMask())
+		{
+			md_draw_glyph(font, src, dst);
+		}
+		else
+		{
+			md_draw_image_scaled(*font.m_Surface, &src, dest, &dst);
+		}
+	});
+}
+
+// Draw text using an 8x8 bitmap font sheet
+void draw_text(Font& font, int x, int y, const char* text, int scale)
+{
+	DrawGlyphs(font, nullptr, x, y, text, scale);
+}
+
+class TextRunCache
+{
+public:
+	struct Run
+	{
+		std::string key;
+		MD_Image* image = nullptr;
+		size_t bytes = 0;
+	};
+
+	TextRunCache()
+	{
+		m_Stats.limit_bytes = MD_DEFAULT_TEXT_CACHE_BYTES;
+	}
+
+	MD_Image* GetRun(Font& font, const char* text, int scale);
+	void EvictToLimit();
+	void Clear();
+
+	// Most recently used at the front
+	std::list<Run> m_Runs;
+	std::unordered_map<std::string, std::list<Run>::iterator> m_Lookup;
+	std::string m_KeyScratch;
+	MD_TextCacheStats m_Stats;
+};
+
+static TextRunCache textRunCache;
+
+MD_Image* TextRunCache::GetRun(Font& font, const char* text, int scale)
+{
+	// The font's address, image and spacing all change what gets drawn
+	m_KeyScratch.clear();
+	const void* keyParts[] = { &font, font.m_Surface };
+	m_KeyScratch.append((const char*)keyParts, sizeof(keyParts));
+	const int keyInts[] = { scale, font.m_SpacingX, font.m_Monospace ? 1 : 0 };
+	m_KeyScratch.append((const char*)keyInts, sizeof(keyInts));
+	m_KeyScratch.append(text);
+
+	auto found = m_Lookup.find(m_KeyScratch);
+	if (found != m_Lookup.end())
+	{
+		m_Stats.hits++;
+		m_Runs.splice(m_Runs.begin(), m_Runs, found->second);
+		return found->second->image;
+	}
+	m_Stats.misses++;
+
+	const int w = font.GetTextWidth(text, scale);
+	const int h = font.m_GlyphSurfaceH * scale;
+	if (w <= 0 || h <= 0)
+	{
+		return nullptr;
+	}
+
+	// Render without the colour mod, it gets applied when the run is drawn. Otherwise a
+	// dark mod could turn glyph pixels into the key colour.
+	MD_Image* image = md_create_image_with_key(w, h, 0, 0, 0);
+	uint8_t modR, modG, modB;
+	md_get_colour_mod(*font.m_Surface, modR, modG, modB);
+	md_set_colour_mod(*font.m_Surface, 255, 255, 255);
+	DrawGlyphs(font, image, 0, 0, text, scale);
+	md_set_colour_mod(*font.m_Surface, modR, modG, modB);
+
+	Run run;
+	run.key = m_KeyScratch;
+	run.image = image;
+	// Charge what the image really holds, which is half as much with an RGB565 canvas
+	MD_PixelBuffer pixels;
+	run.bytes = md_get_image_pixels(*image, pixels) ? (size_t)pixels.pitch * pixels.h : (size_t)w * h * sizeof(uint32_t);
+	m_Runs.push_front(run);
+	m_Lookup[run.key] = m_Runs.begin();
+	m_Stats.bytes += run.bytes;
+	m_Stats.entries++;
+
+	EvictToLimit();
+	return image;
+}
+
+void TextRunCache::EvictToLimit()
+{
+	// Always keep the newest run, even if it's over the limit by itself
+	while (m_Stats.bytes > m_Stats.limit_bytes && m_Runs.size() > 1)
+	{
+		Run& oldest = m_Runs.back();
+		m_Stats.bytes -= oldest.bytes;
+		m_Stats.entries--;
+		m_Stats.evictions++;
+		md_destroy_image(*oldest.image);
+		m_Lookup.erase(oldest.key);
+		m_Runs.pop_back();
+	}
+}
+
+void TextRunCache::Clear()
+{
+	for (Run& run : m_Runs)
+	{
+		md_destroy_image(*run.image);
+	}
+	m_Runs.clear();
+	m_Lookup.clear();
+	m_Stats.bytes = 0;
+	m_Stats.entries = 0;
+}
+
+void draw_text_cached(Font& font, int x, int y, const char* text, int scale)
+{
+	if (textRunCache.m_Stats.limit_bytes == 0)
+	{
+		draw_text(font, x, y, text, scale);
+		return;
+	}
+
+	MD_Image* run = textRunCache.GetRun(font, text, scale);
+	if (!run)
+	{
+		return;
+	}
+
+	uint8_t r, g, b;
+	md_get_colour_mod(*font.m_Surface, r, g, b);
+	md_set_colour_mod(*run, r, g, b);
+	md_draw_image(*run, x, y);
+}
+
+void md_set_text_cache_limit(size_t bytes)
+{
+	textRunCache.m_Stats.limit_bytes = bytes;
+	if (bytes == 0)
+	{
+		textRunCache.Clear();
+		return;
+	}
+	textRunCache.EvictToLimit();
+}
+
+MD_TextCacheStats md_get_text_cache_stats()
+{
+	return textRunCache.m_Stats;
+}
+
+void md_clear_text_cache()
+{
+	textRunCache.Clear();
+}
+
+bool TextLayout::Layout(Font& font, const char* text, int maxWidth, int scale)
+{
+	if (!text)
+	{
+		text = "";
+	}
+	if (m_Font == &font && m_MaxWidth == maxWidth && m_Scale == scale &&
+		m_SpacingX == font.m_SpacingX && m_Monospace == font.m_Monospace && m_Text == text)
+	{
+		return false;
+	}
+
+	Clear();
+	m_Font = &font;
+	m_Text = text;
+	m_MaxWidth = maxWidth;
+	m_Scale = scale;
+	m_SpacingX = font.m_SpacingX;
+	m_Monospace = font.m_Monospace;
+	m_NumLayouts++;
+
+	const int lineHeight = GetLineHeight();
+	const char* cursor = m_Text.c_str();
+	while (*cursor != '\0')
+	{
+		const char* const lineStart = cursor;
+		const uint32_t firstGlyph = (uint32_t)m_Glyphs.size();
+		const int lineY = (int)m_Lines.size() * lineHeight;
+		int penX = 0;
+		int previous = -1;
+
+		// The last place the line could break: the text and glyphs before a run of
+		// spaces, and where the next line would start after them
+		const char* breakEnd = nullptr;
+		const char* breakResume = nullptr;
+		uint32_t breakGlyphs = 0;
+		int breakWidth = 0;
+		bool inSpaces = false;
+
+		const char* lineEnd = nullptr;
+		int lineWidth = 0;
+		while (true)
+		{
+			if (*cursor == '\0' || *cursor == '\n')
+			{
+				lineEnd = cursor;
+				lineWidth = penX;
+				if (*cursor == '\n')
+				{
+					++cursor;
+				}
+				break;
+			}
+
+			const char* const glyphStart = cursor;
+			const uint32_t codepoint = md_decode_utf8(cursor);
+			const bool isSpace = codepoint == ' ';
+			if (isSpace)
+			{
+				if (!inSpaces)
+				{
+					breakEnd = glyphStart;
+					breakGlyphs = (uint32_t)m_Glyphs.size();
+					breakWidth = penX;
+				}
+				breakResume = cursor;
+			}
+			inSpaces = isSpace;
+
+			const int glyph = font.FindGlyph(codepoint);
+			if (glyph < 0)
+			{
+				continue;
+			}
+
+			const Font::GlyphMetrics& metrics = font.m_Glyphs[glyph];
+			const int x = penX + (previous >= 0 ? font.GetKerning(previous, glyph) * scale : 0);
+			const bool lineHasGlyphs = m_Glyphs.size() > firstGlyph;
+			if (!isSpace && lineHasGlyphs && x + (metrics.advance * scale) > maxWidth)
+			{
+				if (breakEnd)
+				{
+					// Back to the last space
+					m_Glyphs.resize(breakGlyphs);
+					lineEnd = breakEnd;
+					lineWidth = breakWidth;
+					cursor = breakResume;
+				}
+				else
+				{
+					// A word too long for the line, so split it here
+					lineEnd = glyphStart;
+					lineWidth = penX;
+					cursor = glyphStart;
+				}
+				break;
+			}
+
+			m_Glyphs.push_back({ (uint16_t)glyph, (int16_t)x, (int16_t)lineY });
+			penX = x + ((metrics.advance + font.m_SpacingX) * scale);
+			previous = glyph;
+		}
+
+		Line line;
+		line.text.assign(lineStart, lineEnd);
+		line.y = lineY;
+		line.width = lineWidth;
+		line.firstGlyph = firstGlyph;
+		line.numGlyphs = (uint32_t)m_Glyphs.size() - firstGlyph;
+		m_Lines.push_back(std::move(line));
+		m_Width = std::max(m_Width, lineWidth);
+	}
+
+	m_Height = (int)m_Lines.size() * lineHeight;
+	return true;
+}
+
+void TextLayout::Clear()
+{
+	m_Font = nullptr;
+	m_Text.clear();
+	m_Width = 0;
+	m_Height = 0;
+	m_Lines.clear();
+	m_Glyphs.clear();
+}
+
+void TextLayout::Draw(int x, int y, int maxHeight) const
+{
+	if (!m_Font)
+	{
+		return;
+	}
+
+	const int lineHeight = GetLineHeight();
+	for (const Line& line : m_Lines)
+	{
+		if (maxHeight > 0 && line.y + lineHeight > maxHeight)
+		{
+			break;
+		}
+		if (!line.text.empty())
+		{
+			draw_text_cached(*m_Font, x, y + line.y, line.text.c_str(), m_Scale);
+		}
+	}
+}
+
+int TextLayout::GetLineHeight() const
+{
+	return m_Font ? m_Font->m_GlyphSurfaceH * m_Scale : 0;
+}
+
+void draw_num(Font& font, int x, int y, const char* text, int scale)
+{
+	const int glyph_width = font.m_GlyphSurfaceW;
+	const int glyph_height = font.m_GlyphSurfaceH;
+	int space_x = 2;
+
+	for (int i = 0; text[i] != '\0'; i++)
+	{
+		int ascii = (unsigned char)text[i] - 1;
+		if (ascii < 47 || ascii > 56)
+		{
+			continue;
+		}
+		ascii -= 47;
+
+		// Calculate position in a 16x8 grid (Standard ASCII layout)
+		int xIdx = ascii % 5;
+		int yIdx = ascii / 5;
+		MD_Rect src = { xIdx * glyph_width, yIdx * glyph_height, glyph_width, glyph_height };
+		MD_Rect dst = { x + (i * (glyph_width + space_x) * scale), y, glyph_width * scale, glyph_height * scale };
+		if (font.HasGlyphMask())
+		{
+			md_draw_glyph(font, src, dst);
+		}
+		else
+		{
+			md_draw_image_scaled(*font.m_Surface, src, dst);
+		}
+		//int res = SDL_BlitSurfaceScaled(font.m_Surface, &src, dest, &dst, SDL_SCALEMODE_NEAREST);
+		//if (res != 0)
+		//{
+		//    const char* err = SDL_GetError();
+		//}
+	}
+}
+
+
+
+
+void PanningImage::InitPanningImage(const char* file, int x, int y, int w, int h)
+{
+	m_Image = md_load_image_with_key(file, 0, 0, 0);
+	m_Rect.x = x;
+	m_Rect.y = y;
+	m_Rect.w = w;
+	m_Rect.h = h;
+}
+
+void PanningImage::UpdateAndDrawPanningImage()
+{
+	md_set_clip(m_Rect);
+	MD_Rect scrolled = m_Rect;
+	if (m_panHorizontal)
+	{
+		scrolled.x += (int)m_Scroll;
+	}
+	else
+	{
+		scrolled.y += (int)m_Scroll;
+	}
+	m_Scroll = m_Scroll + m_Speed;
+	md_draw_image(*m_Image, scrolled.x, scrolled.y);
+	//SDL_BlitSurface(m_Image, NULL, dest, &scrolled);
+	if (m_panHorizontal)
+	{
+		const int w = md_get_image_width(*m_Image);
+		scrolled.x -= w;
+		if (m_Scroll > w)
+		{
+			m_Scroll -= w;
+		}
+	}
+	else
+	{
+		const int h = md_get_image_height(*m_Image);
+		scrolled.y -= h;
+		if (m_Scroll > h)
+		{
+			m_Scroll -= h;
+		}
+	}
+	//SDL_BlitSurface(m_Image, NULL, dest, &scrolled);
+	md_draw_image(*m_Image, scrolled.x, scrolled.y);
+
+	md_clear_clip();
+}
+
+
+
+void FlipBookImage::InitFlipbook(const char* bmpName, int numCols, int numRows, int x, int y)
+{
+	m_Image = md_load_image(bmpName);
+	m_Width = md_get_image_width(*m_Image) / numCols;
+	m_Height = md_get_image_height(*m_Image) / numRows;
+	m_Cols = numCols;
+	m_Rows = numRows;
+	m_X = x;
+	m_Y = y;
+}
+
+void FlipBookImage::UpdateFlipbook()
+{
+	const int sourceIdxX = (m_Frame % m_Cols);
+	const int sourceIdxY = (m_Frame / m_Cols);
+	m_Frame = (m_Frame + 1) % (m_Cols * m_Rows);
+	MD_Rect sourceRect = { sourceIdxX * m_Width, sourceIdxY * m_Height, m_Width, m_Height };
+	MD_Rect destRect = { m_X, m_Y, m_Width, m_Height };
+	md_draw_image(*m_Image, sourceRect, destRect);
+	//SDL_BlitSurface(m_Image, &sourceRect, dest, &destRect);
+}
+
+
+
+
+
+
+
+
+// Internal helper to skip whitespace
+void SkipWhitespace(const char*& json, const char* end) {
+	json = md_json_skip_whitespace(json, end);
+}
+
+JSONArena::JSONArena(size_t capacityBytes)
+	: m_Block(new uint8_t[capacityBytes])
+{
+	m_Stats.capacity_bytes = capacityBytes;
+}
+
+JSONArena::~JSONArena()
+{
+	Reset();
+}
+
+void JSONArena::Reset()
+{
+	for (const Overflow& overflow : m_Overflow)
+	{
+		std::pmr::new_delete_resource()->deallocate(overflow.memory, overflow.bytes, overflow.alignment);
+	}
+	m_Overflow.clear();
+	m_Offset = 0;
+	m_Stats.used_bytes = 0;
+	m_Stats.overflow_bytes = 0;
+	m_Stats.resets++;
+}
+
+void* JSONArena::do_allocate(size_t bytes, size_t alignment)
+{
+	const size_t start = (m_Offset + (alignment - 1)) & ~(alignment - 1);
+	void* memory = nullptr;
+	if (start + bytes <= m_Stats.capacity_bytes)
+	{
+		memory = m_Block.get() + start;
+		m_Stats.used_bytes += (start + bytes) - m_Offset;
+		m_Offset = start + bytes;
+	}
+	else
+	{
+		memory = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		m_Overflow.push_back({ memory, bytes, alignment });
+		m_Stats.used_bytes += bytes;
+		m_Stats.overflow_bytes += bytes;
+	}
+	m_Stats.peak_bytes = std::max(m_Stats.peak_bytes, m_Stats.used_bytes);
+	return memory;
+}
+
+// Nodes and containers come from the arena when there is one, otherwise the heap. Arena
+// memory never has its destructors run, the whole arena is dropped at once instead.
+template <typename T, typename... Args>
+static T* NewJSON(JSONArena* arena, Args&&... args)
+{
+	if (!arena)
+	{
+		return new T(std::forward<Args>(args)...);
+	}
+	return new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+static std::pmr::memory_resource* GetJSONResource(JSONArena* arena)
+{
+	return arena ? (std::pmr::memory_resource*)arena : std::pmr::get_default_resource();
+}
+
+// Number conversions shared by JSONVal, JSONTape and JSONStream. Anything after the number
+// means it wasn't one. Like strtol and strtof, leading whitespace and a plus sign are fine.
+static void SkipNumberPrefix(const char*& text, const char* end)
+{
+	while (text < end && std::isspace((unsigned char)*text)) text++;
+	if (text < end && *text == '+' && end - text > 1 && text[1] != '-') text++;
+}
+
+static int JSONTextToInt(const char* text, size_t length)
+{
+	const char* end = text + length;
+	SkipNumberPrefix(text, end);
+
+	int result = 0;
+	const std::from_chars_result parsed = std::from_chars(text, end, result);
+	if (text == end || parsed.ec != std::errc() || parsed.ptr != end)
+	{
+		return -1;
+	}
+	return result;
+}
+
+static float JSONTextToFloat(const char* text, size_t length)
+{
+	const char* end = text + length;
+	SkipNumberPrefix(text, end);
+
+	float result = 0.0f;
+	const std::from_chars_result parsed = std::from_chars(text, end, result);
+	if (text == end || parsed.ec != std::errc() || parsed.ptr != end)
+	{
+		return 0.0f;
+	}
+	return result;
+}
+
+// Forward declaration
+bool ParseValue(const char*& json, const char* end, JSONVal& node, JSONArena* arena);
+
+// Helper to parse strings (and numbers as strings)
+bool ParseString(const char*& json, const char* end, std::pmr::string& out) 
+{
+	if (*json != '\"')
+	{
+		return false;
+	}
+
+	json++; // skip opening quote
+	while (json < end)
+	{
+		// Everything up to the next quote or backslash goes across in one go
+		const char* span = json;
+		json = md_json_find_quote_or_backslash(json, end);
+		out.append(span, json - span);
+		if (json == end || *json == '\"')
+		{
+			break;
+		}
+
+		// Detect escaped character. Move along to it, it will be copied to the string.
+		json++;
+		if (json < end)
+		{
+			out += *json++;
+		}
+	}
+	if (json < end && *json == '\"')
+	{
+		json++; // skip closing quote
+		return true;
+	}
+	return false;
+}
+
+// Helper to parse raw numbers as strings per your requirement
+bool ParseNumberAsString(const char*& json, std::pmr::string& out) {
+	const char* start = json;
+	if (*json == '-') json++;
+	while (*json && (std::isdigit(*json) || *json == '.' || *json == 'e' || *json == 'E' || *json == '+' || *json == '-')) {
+		json++;
+	}
+	if (json == start) return false;
+	out.assign(start, json - start);
+	return true;
+}
+
+bool ParseValue(const char*& json, const char* end, JSONVal& node, JSONArena* arena) {
+	SkipWhitespace(json, end);
+	std::pmr::memory_resource* resource = GetJSONResource(arena);
+
+	if (*json == '{') // Object
+	{
+		node.m_object = NewJSON<JSONObject>(arena, resource);
+		json++;
+		while (*json && *json != '}')
+		{
+			SkipWhitespace(json, end);
+			std::pmr::string key(resource);
+			if (!ParseString(json, end, key)) return false;
+
+			SkipWhitespace(json, end);
+			if (*json != ':') return false;
+			json++; // skip ':'
+
+			JSONVal* child = NewJSON<JSONVal>(arena);
+			auto [entry, added] = node.m_object->try_emplace(std::move(key), child);
+			if (!added)
+			{
+				// Last one wins for repeated keys
+				if (!arena) delete entry->second;
+				entry->second = child;
+			}
+			if (!ParseValue(json, end, *child, arena)) return false;
+
+			SkipWhitespace(json, end);
+			if (*json == ',') json++;
+		}
+		if (*json == '}') { json++; return true; }
+	}
+	else if (*json == '[') { // Array
+		node.m_array = NewJSON<JSONArray>(arena, resource);
+		json++;
+		while (*json && *json != ']') {
+			JSONVal* child = NewJSON<JSONVal>(arena);
+			node.m_array->push_back(child);
+			if (!ParseValue(json, end, *child, arena)) return false;
+
+			SkipWhitespace(json, end);
+			if (*json == ',') json++;
+		}
+		if (*json == ']') { json++; return true; }
+	}
+	else if (*json == '\"') { // String
+		node.m_value = NewJSON<std::pmr::string>(arena, resource);
+		return ParseString(json, end, *node.m_value);
+	}
+	else if (std::isdigit(*json) || *json == '-') { // Number
+		node.m_value = NewJSON<std::pmr::string>(arena, resource);
+		if (!ParseNumberAsString(json, *node.m_value)) return false;
+		node.m_isNumber = true;
+		node.m_asInt = JSONTextToInt(node.m_value->data(), node.m_value->length());
+		node.m_asFloat = JSONTextToFloat(node.m_value->data(), node.m_value->length());
+		return true;
+	}
+
+	return false;
+}
+
+bool ParseJSON(const char* json, JSONVal& jsonDocOut)
+{
+	jsonDocOut.Reset();
+	if (!json) return false;
+	return ParseValue(json, json + strlen(json), jsonDocOut, jsonDocOut.m_Arena.get());
+}
+
+/**
+ * Loads a file from disk and parses it into the provided JSONVal structure.
+ * Works on Windows, Linux, and macOS.
+ */
+bool ParseJSONFile(const char* filename, JSONVal& jsonDocOut)
+{
+	MD_PROFILE_SCOPE(MD_STAT_PARSE_JSON_FILE, 0);
+	jsonDocOut.Reset();
+
+	// Read rather than mapped, ParseJSON copies everything it keeps so a mapping saves nothing
+	MD_MappedFile file;
+	if (!file.Read(filename)) {
+		return false; // File not found or access denied
+	}
+
+	MD_PROFILE_COUNT(MD_STAT_PARSE_JSON_FILE, file.Size());
+
+	// Check if file was empty
+	if (file.Size() == 0) {
+		return false;
+	}
+
+	return ParseJSON((const char*)file.Data(), jsonDocOut);
+}
+
+bool ParseJSONFile(const char* filename, JSONTape& tapeOut, bool* changedOut)
+{
+	MD_PROFILE_SCOPE(MD_STAT_PARSE_JSON_FILE, 0);
+	if (changedOut)
+	{
+		*changedOut = false;
+	}
+
+	MD_FileInfo info;
+	const bool exists = md_get_file_info(filename, info);
+	if (exists && tapeOut.m_Source.IsUnchanged(filename, info))
+	{
+		return tapeOut.m_Source.Succeeded();
+	}
+
+	if (changedOut)
+	{
+		*changedOut = true;
+	}
+	tapeOut.Clear();
+
+	bool parsed = false;
+	if (exists && tapeOut.m_File.Read(filename))
+	{
+		MD_PROFILE_COUNT(MD_STAT_PARSE_JSON_FILE, tapeOut.m_File.Size());
+		parsed = tapeOut.m_File.Size() > 0 && tapeOut.ParseInSitu((char*)tapeOut.m_File.MutableData(), tapeOut.m_File.Size());
+	}
+
+	if (exists)
+	{
+		tapeOut.m_Source.Remember(filename, info, parsed);
+	}
+	return parsed;
+}
+
+JSONPath::JSONPath(const char* path)
+{
+	if (!path)
+	{
+		return;
+	}
+
+	const char* cursor = path;
+	while (*cursor)
+	{
+		Step step;
+		if (*cursor == '[')
+		{
+			const char* end = strchr(cursor, ']');
+			if (!end || std::from_chars(cursor + 1, end, step.index).ptr != end || step.index < 0)
+			{
+				m_Steps.clear();
+				return;
+			}
+			cursor = end + 1;
+		}
+		else
+		{
+			// A member name runs to the next separator, and needs one before it unless it
+			// comes first
+			if (cursor != path)
+			{
+				if (*cursor != '.')
+				{
+					m_Steps.clear();
+					return;
+				}
+				cursor++;
+			}
+			const size_t length = strcspn(cursor, ".[");
+			if (length == 0)
+			{
+				m_Steps.clear();
+				return;
+			}
+			step.name.assign(cursor, length);
+			cursor += length;
+		}
+		m_Steps.push_back(std::move(step));
+	}
+	m_Valid = !m_Steps.empty();
+}
+
+JSONVal JSONVal::Invalid;
+
+void JSONVal::Reset()
+{
+	if (m_Arena)
+	{
+		// Children never get destructed, their memory all goes back with the arena
+		m_object = nullptr;
+		m_value = nullptr;
+		m_array = nullptr;
+		m_isNumber = false;
+		m_Arena->Reset();
+		return;
+	}
+
+	m_isNumber = false;
+	delete m_value;
+	m_value = nullptr;
+	if (m_object)
+	{
+		for (auto const& [key, val] : *m_object) delete val;
+		delete m_object;
+		m_object = nullptr;
+	}
+	if (m_array)
+	{
+		for (auto* item : *m_array) delete item;
+		delete m_array;
+		m_array = nullptr;
+	}
+}
+
+void JSONVal::UseArena(size_t capacityBytes)
+{
+	Reset();
+	m_Arena = std::make_unique<JSONArena>(capacityBytes);
+}
+
+const JSONVal& JSONVal::GetObject(const char* name) const
+{
+	if (m_object == nullptr)
+	{
+		return Invalid;
+	}
+
+	auto found = m_object->find(std::string_view(name));
+	if (found == m_object->end())
+	{
+		return Invalid;
+	}
+
+	return *found->second;
+}
+
+const JSONVal& JSONVal::Get(const JSONPath& path) const
+{
+	if (!path.IsValid())
+	{
+		return Invalid;
+	}
+
+	const JSONVal* val = this;
+	for (const JSONPath::Step& step : path.m_Steps)
+	{
+		val = step.index < 0 ? &val->GetObject(step.name.c_str()) : &val->GetArrayVal(step.index);
+	}
+	return *val;
+}
+
+const JSONVal& JSONVal::GetArrayVal(int index) const
+{
+	if (m_array == nullptr)
+	{
+		return Invalid;
+	}
+	if (index < 0 || index >= (int)m_array->size())
+	{
+		return Invalid;
+	}
+
+	return *m_array->at(index);
+}
+
+int JSONVal::GetAsInt() const
+{
+	if (m_value == nullptr)
+	{
+		return -1;
+	}
+	if (m_isNumber)
+	{
+		return m_asInt;
+	}
+
+	return JSONTextToInt(m_value->c_str(), m_value->length());
+}
+
+float JSONVal::GetAsFloat() const
+{
+	if (m_value == nullptr)
+	{
+		return 0.0f;
+	}
+	if (m_isNumber)
+	{
+		return m_asFloat;
+	}
+
+	return JSONTextToFloat(m_value->c_str(), m_value->length());
+}
+
+const char* JSONVal::GetAsString() const
+{
+	if (m_value == nullptr)
+	{
+		return "";
+	}
+
+	return m_value->c_str();
+}
+
+bool JSONTape::Parse(const char* json)
+{
+	if (!json)
+	{
+		Clear();
+		return false;
+	}
+	m_Buffer.assign(json);
+	return ParseInSitu(m_Buffer.data(), m_Buffer.size());
+}
+
+bool JSONTape::ParseInSitu(char* json)
+{
+	return ParseInSitu(json, json ? strlen(json) : 0);
+}
+
+bool JSONTape::ParseInSitu(char* json, size_t length)
+{
+	Clear();
+	if (!json || length >= UINT32_MAX || !md_json_index(json, length, m_Indices))
+	{
+		return false;
+	}
+
+	m_Text = json;
+	m_ParseText = json;
+	m_ParseEnd = json + length;
+	size_t token = 0;
+	const bool parsed = ParseValue(token, 0, 0);
+	m_ParseText = nullptr;
+	m_ParseEnd = nullptr;
+	if (!parsed)
+	{
+		Clear();
+		return false;
+	}
+
+	// Numbers end at whatever follows them, which the parser no longer needs. Terminate
+	// them so they read as C strings like everything else.
+	for (const Node& node : m_Nodes)
+	{
+		if (node.type == NUMBER)
+		{
+			json[node.value + node.valueLength] = '\0';
+		}
+	}
+	return true;
+}
+
+void JSONTape::Clear()
+{
+	m_Nodes.clear();
+	m_Text = nullptr;
+	m_Source.Forget();
+}
+
+JSONTapeVal JSONTape::GetRoot() const
+{
+	return m_Nodes.empty() ? JSONTapeVal() : JSONTapeVal(this, 0);
+}
+
+// Same rules as ParseString for JSONVal, a backslash keeps the next character as is. The
+// unescaped string is written back over itself, ending with a terminator where it's shorter
+// or the closing quote was. Strings without escapes are left where they are.
+bool JSONTape::ParseString(uint32_t quote, uint32_t& offset, uint32_t& length)
+{
+	char* const start = m_ParseText + quote + 1;
+	char* json = start;
+	char* out = start;
+	while (true)
+	{
+		char* const span = json;
+		json += md_json_find_quote_or_backslash(json, m_ParseEnd) - json;
+		if (out != span)
+		{
+			memmove(out, span, json - span);
+		}
+		out += json - span;
+
+		if (json == m_ParseEnd)
+		{
+			return false;
+		}
+		if (*json == '\"')
+		{
+			break;
+		}
+		json++; // skip the backslash
+		if (json == m_ParseEnd)
+		{
+			return false;
+		}
+		*out++ = *json++;
+	}
+	*out = '\0';
+
+	offset = (uint32_t)(start - m_ParseText);
+	length = (uint32_t)(out - start);
+	return true;
+}
+
+static bool IsJSONNumberChar(char c)
+{
+	return std::isdigit((unsigned char)c) || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+}
+
+bool JSONTape::ParseValue(size_t& token, uint32_t key, uint32_t keyLength)
+{
+	if (token >= m_Indices.size())
+	{
+		return false;
+	}
+
+	// Only token positions are read from here on. Strings are only ever rewritten past
+	// their opening quote, so these are never touched by the unescaping.
+	char* const text = m_ParseText;
+	const uint32_t position = m_Indices[token++];
+	const size_t numTokens = m_Indices.size();
+
+	const uint32_t index = (uint32_t)m_Nodes.size();
+	Node node;
+	node.key = key;
+	node.keyLength = keyLength;
+	m_Nodes.push_back(node);
+
+	if (text[position] == '{') // Object
+	{
+		m_Nodes[index].type = OBJECT;
+		uint32_t count = 0;
+		while (token < numTokens && text[m_Indices[token]] != '}')
+		{
+			const uint32_t quote = m_Indices[token++];
+			uint32_t memberKey = 0;
+			uint32_t memberKeyLength = 0;
+			if (text[quote] != '\"' || !ParseString(quote, memberKey, memberKeyLength)) return false;
+
+			if (token >= numTokens || text[m_Indices[token]] != ':') return false;
+			token++; // skip ':'
+
+			if (!ParseValue(token, memberKey, memberKeyLength)) return false;
+			count++;
+
+			if (token < numTokens && text[m_Indices[token]] == ',') token++;
+		}
+		if (token >= numTokens) return false;
+		token++; // skip '}'
+		m_Nodes[index].count = count;
+	}
+	else if (text[position] == '[') // Array
+	{
+		m_Nodes[index].type = ARRAY;
+		uint32_t count = 0;
+		while (token < numTokens && text[m_Indices[token]] != ']')
+		{
+			if (!ParseValue(token, 0, 0)) return false;
+			count++;
+
+			if (token < numTokens && text[m_Indices[token]] == ',') token++;
+		}
+		if (token >= numTokens) return false;
+		token++; // skip ']'
+		m_Nodes[index].count = count;
+	}
+	else if (text[position] == '\"') // String
+	{
+		m_Nodes[index].type = STRING;
+		if (!ParseString(position, m_Nodes[index].value, m_Nodes[index].valueLength)) return false;
+	}
+	else if (std::isdigit((unsigned char)text[position]) || text[position] == '-') // Number
+	{
+		const char* json = text + position + 1;
+		while (json < m_ParseEnd && IsJSONNumberChar(*json))
+		{
+			json++;
+		}
+
+		// Stage one runs a number and anything stuck to it together as one token
+		if (json < m_ParseEnd && *json != ' ' && *json != '\t' && *json != '\n' && *json != '\r' &&
+			*json != ',' && *json != ']' && *json != '}' && *json != '\0')
+		{
+			return false;
+		}
+		Node& number = m_Nodes[index];
+		number.type = NUMBER;
+		number.value = position;
+		number.valueLength = (uint32_t)(json - (text + position));
+		number.intValue = JSONTextToInt(text + position, number.valueLength);
+		number.floatValue = JSONTextToFloat(text + position, number.valueLength);
+	}
+	else
+	{
+		return false;
+	}
+
+	m_Nodes[index].next = (uint32_t)m_Nodes.size();
+	return true;
+}
+
+bool JSONTapeVal::IsObject() const
+{
+	return m_Tape && m_Tape->m_Nodes[m_Index].type == JSONTape::OBJECT;
+}
+
+bool JSONTapeVal::IsArray() const
+{
+	return m_Tape && m_Tape->m_Nodes[m_Index].type == JSONTape::ARRAY;
+}
+
+// Index of an object's member or an array's element, or NO_NODE if it isn't there.
+// Members and elements sit one after another following their parent, walked by their
+// next index.
+static const uint32_t NO_NODE = UINT32_MAX;
+
+static uint32_t FindTapeMember(const JSONTape& tape, uint32_t index, std::string_view key)
+{
+	const std::vector<JSONTape::Node>& nodes = tape.m_Nodes;
+	if (nodes[index].type != JSONTape::OBJECT)
+	{
+		return NO_NODE;
+	}
+
+	// Carries on past a match, a repeated key means its last value (see JSONTape)
+	uint32_t found = NO_NODE;
+	uint32_t child = index + 1;
+	for (uint32_t i = 0; i < nodes[index].count; ++i)
+	{
+		const JSONTape::Node& node = nodes[child];
+		if (node.keyLength == key.size() && memcmp(tape.m_Text + node.key, key.data(), key.size()) == 0)
+		{
+			found = child;
+		}
+		child = node.next;
+	}
+	return found;
+}
+
+static uint32_t FindTapeElement(const JSONTape& tape, uint32_t index, int element)
+{
+	const std::vector<JSONTape::Node>& nodes = tape.m_Nodes;
+	if (nodes[index].type != JSONTape::ARRAY || element < 0 || element >= (int)nodes[index].count)
+	{
+		return NO_NODE;
+	}
+
+	uint32_t child = index + 1;
+	for (int i = 0; i < element; ++i)
+	{
+		child = nodes[child].next;
+	}
+	return child;
+}
 
-// Internal helper to skip whitespace
-void SkipWhitespace(const char*& json) {
-	while (*json && std::isspace(*json)) json++;
+const JSONTapeVal JSONTapeVal::GetObject(const char* name) const
+{
+	const uint32_t child = m_Tape ? FindTapeMember(*m_Tape, m_Index, name) : NO_NODE;
+	return child != NO_NODE ? JSONTapeVal(m_Tape, child) : JSONTapeVal();
 }
 
-// Forward declaration
-bool ParseValue(const char*& json, JSONVal& node);
+const JSONTapeVal JSONTapeVal::GetArrayVal(int index) const
+{
+	const uint32_t child = m_Tape ? FindTapeElement(*m_Tape, m_Index, index) : NO_NODE;
+	return child != NO_NODE ? JSONTapeVal(m_Tape, child) : JSONTapeVal();
+}
 
-// Helper to parse strings (and numbers as strings)
-bool ParseString(const char*& json, std::string& out) 
+const JSONTapeVal JSONTapeVal::Get(const JSONPath& path) const
 {
-	if (*json != '\"')
+	if (!m_Tape || !path.IsValid())
 	{
-		return false;
+		return JSONTapeVal();
 	}
 
-	json++; // skip opening quote
-	while (*json && *json != '\"') 
+	uint32_t index = m_Index;
+	for (const JSONPath::Step& step : path.m_Steps)
 	{
-		// Detect escaped character
-		if (*json == '\\')
+		index = step.index < 0 ? FindTapeMember(*m_Tape, index, step.name) : FindTapeElement(*m_Tape, index, step.index);
+		if (index == NO_NODE)
 		{
-			// Move along to the escaped character. It will
-			// be copied to the string.
-			json++;
+			return JSONTapeVal();
 		}
-		out += *json++;
 	}
-	if (*json == '\"')
+	return JSONTapeVal(m_Tape, index);
+}
+
+int JSONTapeVal::GetAsInt() const
+{
+	if (!m_Tape || m_Tape->m_Nodes[m_Index].type < JSONTape::STRING)
 	{
-		json++; // skip closing quote
-		return true;
+		return -1;
 	}
-	return false;
-}
 
-// Helper to parse raw numbers as strings per your requirement
-bool ParseNumberAsString(const char*& json, std::string& out) {
-	const char* start = json;
-	if (*json == '-') json++;
-	while (*json && (std::isdigit(*json) || *json == '.' || *json == 'e' || *json == 'E' || *json == '+' || *json == '-')) {
-		json++;
+	const JSONTape::Node& node = m_Tape->m_Nodes[m_Index];
+	if (node.type == JSONTape::NUMBER)
+	{
+		return node.intValue;
 	}
-	if (json == start) return false;
-	out = std::string(start, json - start);
-	return true;
+	return JSONTextToInt(m_Tape->m_Text + node.value, node.valueLength);
 }
 
-bool ParseValue(const char*& json, JSONVal& node) {
-	SkipWhitespace(json);
+float JSONTapeVal::GetAsFloat() const
+{
+	if (!m_Tape || m_Tape->m_Nodes[m_Index].type < JSONTape::STRING)
+	{
+		return 0.0f;
+	}
+
+	const JSONTape::Node& node = m_Tape->m_Nodes[m_Index];
+	if (node.type == JSONTape::NUMBER)
+	{
+		return node.floatValue;
+	}
+	return JSONTextToFloat(m_Tape->m_Text + node.value, node.valueLength);
+}
 
-	if (*json == '{') // Object
+const char* JSONTapeVal::GetAsString() const
+{
+	if (!m_Tape || m_Tape->m_Nodes[m_Index].type < JSONTape::STRING)
 	{
-		node.m_object = new std::map<std::string, JSONVal*>();
-		json++;
-		while (*json && *json != '}')
-		{
-			SkipWhitespace(json);
-			std::string key;
-			if (!ParseString(json, key)) return false;
+		return "";
+	}
 
-			SkipWhitespace(json);
-			if (*json != ':') return false;
-			json++; // skip ':'
+	return m_Tape->m_Text + m_Tape->m_Nodes[m_Index].value;
+}
 
-			JSONVal* child = new JSONVal();
-			if (!ParseValue(json, *child)) return false;
-			(*node.m_object)[key] = child;
+int JSONTapeVal::GetCount() const
+{
+	return (IsObject() || IsArray()) ? (int)m_Tape->m_Nodes[m_Index].count : 0;
+}
 
-			SkipWhitespace(json);
-			if (*json == ',') json++;
-		}
-		if (*json == '}') { json++; return true; }
+std::string_view JSONTapeVal::GetKey() const
+{
+	if (!m_Tape)
+	{
+		return std::string_view();
 	}
-	else if (*json == '[') { // Array
-		node.m_array = new std::vector<JSONVal*>();
-		json++;
-		while (*json && *json != ']') {
-			JSONVal* child = new JSONVal();
-			if (!ParseValue(json, *child)) return false;
-			node.m_array->push_back(child);
 
-			SkipWhitespace(json);
-			if (*json == ',') json++;
-		}
-		if (*json == ']') { json++; return true; }
-	}
-	else if (*json == '\"') { // String
-		node.m_value = new std::string();
-		return ParseString(json, *node.m_value);
-	}
-	else if (std::isdigit(*json) || *json == '-') { // Number
-		node.m_value = new std::string();
-		return ParseNumberAsString(json, *node.m_value);
+	const JSONTape::Node& node = m_Tape->m_Nodes[m_Index];
+	return std::string_view(m_Tape->m_Text + node.key, node.keyLength);
+}
+
+std::string_view JSONTapeVal::GetView() const
+{
+	if (!m_Tape || m_Tape->m_Nodes[m_Index].type < JSONTape::STRING)
+	{
+		return std::string_view();
 	}
 
-	return false;
+	const JSONTape::Node& node = m_Tape->m_Nodes[m_Index];
+	return std::string_view(m_Tape->m_Text + node.value, node.valueLength);
 }
 
-bool ParseJSON(const char* json, JSONVal& jsonDocOut)
+void JSONStream::Bind(const char* path, int& out)
 {
-	jsonDocOut.Reset();
-	if (!json) return false;
-	return ParseValue(json, jsonDocOut);
+	AddBinding(path, BIND_INT, &out);
 }
 
-/**
- * Loads a file from disk and parses it into the provided JSONVal structure.
- * Works on Windows, Linux, and macOS.
- */
-bool ParseJSONFile(const char* filename, JSONVal& jsonDocOut)
+void JSONStream::Bind(const char* path, float& out)
 {
-	jsonDocOut.Reset();
+	AddBinding(path, BIND_FLOAT, &out);
+}
 
-	// Open the file in input mode
-	std::ifstream file(filename);
+void JSONStream::Bind(const char* path, std::string& out)
+{
+	AddBinding(path, BIND_STRING, &out);
+}
 
-	if (!file.is_open()) {
-		return false; // File not found or access denied
-	}
+void JSONStream::ClearBindings()
+{
+	m_Bindings.clear();
+}
 
-	// Use a stringstream to read the entire file content into a string buffer
-	std::stringstream buffer;
-	buffer << file.rdbuf();
-	std::string content = buffer.str();
+void JSONStream::AddBinding(const char* path, BindingType type, void* out)
+{
+	Binding binding;
+	binding.path = path;
+	binding.type = type;
+	binding.out = out;
+	m_Bindings.push_back(std::move(binding));
+}
 
-	// Close the file explicitly (though ifstream destructor handles this too)
-	file.close();
+void JSONStream::Begin()
+{
+	m_State = VALUE;
+	m_Scopes.clear();
+	m_Path.clear();
+	m_Token.clear();
+	m_NumFound = 0;
+}
 
-	// Check if file was empty
-	if (content.empty()) {
-		return false;
+bool JSONStream::End()
+{
+	// A number at the very end has nothing after it to finish it
+	if (m_State == NUMBER)
+	{
+		EndNumber();
 	}
-
-	// Call your existing parser
-	return ParseJSON(content.c_str(), jsonDocOut);
+	return m_State == DONE;
 }
 
-JSONVal JSONVal::Invalid;
+static bool IsJSONWhitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-void JSONVal::Reset()
+bool JSONStream::Feed(const char* data, size_t size)
 {
-	delete m_value;
-	if (m_object)
+	const char* const end = data + size;
+	while (data < end && m_State != FAILED)
 	{
-		for (auto const& [key, val] : *m_object) delete val;
-		delete m_object;
-		m_object = nullptr;
+		const char c = *data;
+		switch (m_State)
+		{
+		case VALUE:
+			if (IsJSONWhitespace(c))
+			{
+				data = md_json_skip_whitespace(data, end);
+				continue;
+			}
+			if (c == ']' && !m_Scopes.empty() && !m_Scopes.back().isObject)
+			{
+				EndContainer(false);
+			}
+			else if (c == '{' || c == '[')
+			{
+				BeginValue();
+				BeginContainer(c == '{');
+			}
+			else if (c == '\"')
+			{
+				BeginValue();
+				m_Token.clear();
+				m_StringIsKey = false;
+				m_State = STRING;
+			}
+			else if (std::isdigit((unsigned char)c) || c == '-')
+			{
+				BeginValue();
+				m_Token.assign(1, c);
+				m_State = NUMBER;
+			}
+			else
+			{
+				m_State = FAILED;
+			}
+			break;
+
+		case KEY:
+			if (IsJSONWhitespace(c))
+			{
+				data = md_json_skip_whitespace(data, end);
+				continue;
+			}
+			if (c == '}')
+			{
+				EndContainer(true);
+			}
+			else if (c == '\"')
+			{
+				m_Token.clear();
+				m_StringIsKey = true;
+				m_State = STRING;
+			}
+			else
+			{
+				m_State = FAILED;
+			}
+			break;
+
+		case COLON:
+			if (IsJSONWhitespace(c))
+			{
+				data = md_json_skip_whitespace(data, end);
+				continue;
+			}
+			m_State = c == ':' ? VALUE : FAILED;
+			break;
+
+		case AFTER_VALUE:
+			if (IsJSONWhitespace(c))
+			{
+				data = md_json_skip_whitespace(data, end);
+				continue;
+			}
+			if (c == ',')
+			{
+				m_State = m_Scopes.back().isObject ? KEY : VALUE;
+			}
+			else if (c == '}' || c == ']')
+			{
+				if (!EndContainer(c == '}'))
+				{
+					m_State = FAILED;
+				}
+			}
+			else
+			{
+				// Commas are optional, as they are for ParseJSON
+				m_State = m_Scopes.back().isObject ? KEY : VALUE;
+				continue;
+			}
+			break;
+
+		case STRING:
+		{
+			// Everything up to the next quote or backslash goes across in one go
+			const char* stop = md_json_find_quote_or_backslash(data, end);
+			m_Token.append(data, stop - data);
+			data = stop;
+			if (data == end)
+			{
+				continue;
+			}
+			if (*data == '\"')
+			{
+				EndString();
+			}
+			else
+			{
+				m_State = STRING_ESCAPE;
+			}
+			break;
+		}
+
+		case STRING_ESCAPE:
+			// Same rule as ParseJSON, the escaped character is kept as is
+			m_Token += c;
+			m_State = STRING;
+			break;
+
+		case NUMBER:
+			if (IsJSONNumberChar(c))
+			{
+				const char* stop = data + 1;
+				while (stop < end && IsJSONNumberChar(*stop))
+				{
+					stop++;
+				}
+				m_Token.append(data, stop - data);
+				data = stop;
+				continue;
+			}
+			if (!IsJSONWhitespace(c) && c != ',' && c != ']' && c != '}')
+			{
+				m_State = FAILED;
+				continue;
+			}
+			EndNumber();
+			continue;
+
+		case DONE:
+		case FAILED:
+			return m_State != FAILED;
+		}
+		data++;
 	}
-	if (m_array)
+	return m_State != FAILED;
+}
+
+// Elements of an array get their index added to the path as they start
+void JSONStream::BeginValue()
+{
+	if (!m_Scopes.empty() && !m_Scopes.back().isObject)
 	{
-		for (auto* item : *m_array) delete item;
-		delete m_array;
-		m_array = nullptr;
+		const Scope& scope = m_Scopes.back();
+		char index[16];
+		index[0] = '[';
+		char* indexEnd = std::to_chars(index + 1, index + sizeof(index) - 1, scope.count).ptr;
+		*indexEnd++ = ']';
+		m_Path.resize(scope.pathLength);
+		m_Path.append(index, indexEnd - index);
 	}
 }
 
-const JSONVal& JSONVal::GetObject(const char* name) const
+void JSONStream::BeginContainer(bool isObject)
 {
-	if (m_object == nullptr)
+	Scope scope;
+	scope.isObject = isObject;
+	scope.pathLength = m_Path.size();
+	m_Scopes.push_back(scope);
+	m_State = isObject ? KEY : VALUE;
+
+	if (m_Handler)
 	{
-		return Invalid;
+		isObject ? m_Handler->OnBeginObject() : m_Handler->OnBeginArray();
 	}
-	if (!m_object->contains(name))
+}
+
+bool JSONStream::EndContainer(bool isObject)
+{
+	if (m_Scopes.empty() || m_Scopes.back().isObject != isObject)
 	{
-		return Invalid;
+		return false;
 	}
+	m_Path.resize(m_Scopes.back().pathLength);
+	m_Scopes.pop_back();
 
-	return *m_object->find(name)->second;
+	if (m_Handler)
+	{
+		isObject ? m_Handler->OnEndObject() : m_Handler->OnEndArray();
+	}
+	EndValue();
+	return true;
 }
 
-const JSONVal& JSONVal::GetArrayVal(int index) const
+void JSONStream::EndString()
 {
-	if (m_array == nullptr)
+	if (!m_StringIsKey)
 	{
-		return Invalid;
+		if (m_Handler)
+		{
+			m_Handler->OnString(m_Token);
+		}
+		SetBoundValues();
+		EndValue();
+		return;
 	}
-	if (index < 0 || index >= m_array->size())
+
+	// The member's path replaces the previous member's
+	const Scope& scope = m_Scopes.back();
+	m_Path.resize(scope.pathLength);
+	if (scope.pathLength > 0)
 	{
-		return Invalid;
+		m_Path += '.';
 	}
+	m_Path += m_Token;
+	m_State = COLON;
 
-	return *m_array->at(index);
+	if (m_Handler)
+	{
+		m_Handler->OnKey(m_Token);
+	}
 }
 
-int JSONVal::GetAsInt() const
+void JSONStream::EndNumber()
 {
-	if (m_value == nullptr)
+	if (m_Handler)
 	{
-		return -1;
+		m_Handler->OnNumber(m_Token);
 	}
+	SetBoundValues();
+	EndValue();
+}
 
-	if (m_value->empty())
+void JSONStream::EndValue()
+{
+	if (m_Scopes.empty())
 	{
-		return -1;
+		m_State = DONE;
+		return;
 	}
+	m_Scopes.back().count++;
+	m_State = AFTER_VALUE;
+}
 
-	size_t processed_char_count = 0;
-	int result = std::stoi(*m_value, &processed_char_count);
+// Strings and numbers convert the same way they do through JSONVal
+void JSONStream::SetBoundValues()
+{
+	for (const Binding& binding : m_Bindings)
+	{
+		if (binding.path != m_Path)
+		{
+			continue;
+		}
 
-	// If the number of characters processed by stoi is less than 
-	// the string length, the string contained trailing garbage.
-	if (processed_char_count != m_value->length()) {
-		return -1;
+		switch (binding.type)
+		{
+		case BIND_INT:
+			*(int*)binding.out = JSONTextToInt(m_Token.c_str(), m_Token.length());
+			break;
+		case BIND_FLOAT:
+			*(float*)binding.out = JSONTextToFloat(m_Token.c_str(), m_Token.length());
+			break;
+		case BIND_STRING:
+			*(std::string*)binding.out = m_Token;
+			break;
+		}
+		m_NumFound++;
 	}
-
-	return result;
 }
 
-float JSONVal::GetAsFloat() const
+bool ParseJSONFile(const char* filename, JSONStream& streamOut, bool* changedOut)
 {
-	if (m_value == nullptr)
+	MD_PROFILE_SCOPE(MD_STAT_PARSE_JSON_FILE, 0);
+	if (changedOut)
 	{
-		return 0.0f;
+		*changedOut = false;
 	}
 
-	if (m_value->empty())
+	MD_FileInfo info;
+	const bool exists = md_get_file_info(filename, info);
+	if (exists && streamOut.m_Source.IsUnchanged(filename, info))
 	{
-		return 0.0f;
+		return streamOut.m_Source.Succeeded();
 	}
 
-	size_t processed_char_count = 0;
-	float result = std::stof(*m_value, &processed_char_count);
-
-	// If the number of characters processed by stof is less than 
-	// the string length, the string contained trailing garbage.
-	if (processed_char_count != m_value->length()) {
-		return 0.0f;
+	if (changedOut)
+	{
+		*changedOut = true;
 	}
+	streamOut.m_Source.Forget();
 
-	return result;
-}
+	if (!exists)
+	{
+		return false;
+	}
 
-const char* JSONVal::GetAsString() const
-{
-	if (m_value == nullptr)
+	// However big the file gets, only one chunk of it is held at a time
+	char chunk[4096];
+	streamOut.Begin();
+	size_t totalBytes = 0;
+	const bool read = md_read_file_chunks(filename, chunk, sizeof(chunk), [&](const void* data, size_t size)
 	{
-		return "";
+		totalBytes += size;
+		return streamOut.Feed((const char*)data, size);
+	});
+	if (!read)
+	{
+		return false;
 	}
+	MD_PROFILE_COUNT(MD_STAT_PARSE_JSON_FILE, totalBytes);
 
-	return m_value->c_str();
+	const bool parsed = streamOut.End();
+	streamOut.m_Source.Remember(filename, info, parsed);
+	return parsed;
 }
 
 
@@ -513,29 +2711,186 @@ int LerpInt(float t, int from, int to)
  */
 void LoadConfigToMap(const char* filename, Values& configMap)
 {
-	std::ifstream file(filename);
+	MD_PROFILE_SCOPE(MD_STAT_LOAD_CONFIG, 0);
+	MD_MappedFile file;
 
-	if (!file.is_open())
+	if (!file.Open(filename))
 	{
 		std::cerr << "Error: Could not open file " << filename << std::endl;
 		return;
 	}
 
-	std::string line;
-	while (std::getline(file, line))
+	MD_PROFILE_COUNT(MD_STAT_LOAD_CONFIG, file.Size());
+	LoadConfigText((const char*)file.Data(), file.Size(), configMap);
+}
+
+void LoadConfigText(const char* text, size_t length, Values& configMap)
+{
+	const char* const end = text + length;
+	while (text < end)
 	{
+		const char* lineEnd = (const char*)memchr(text, '\n', end - text);
+		if (!lineEnd)
+		{
+			lineEnd = end;
+		}
+		const std::string_view line(text, lineEnd - text);
+		text = lineEnd + (lineEnd < end ? 1 : 0);
+
 		// Skip empty lines to prevent errors
 		if (line.empty()) continue;
 
 		size_t delimiterPos = line.find('=');
 
-		if (delimiterPos != std::string::npos) {
-			std::string key = line.substr(0, delimiterPos);
-			std::string value = line.substr(delimiterPos + 1);
+		if (delimiterPos != std::string_view::npos) {
+			configMap[std::string(line.substr(0, delimiterPos))] = line.substr(delimiterPos + 1);
+		}
+	}
+}
+
+static size_t HashConfigKey(std::string_view key)
+{
+	return (size_t)md_hash64(key.data(), key.size());
+}
+
+bool ConfigValues::Load(const char* filename)
+{
+	MD_PROFILE_SCOPE(MD_STAT_LOAD_CONFIG, 0);
+	MD_MappedFile file;
+
+	if (!file.Open(filename))
+	{
+		std::cerr << "Error: Could not open file " << filename << std::endl;
+		return false;
+	}
+
+	MD_PROFILE_COUNT(MD_STAT_LOAD_CONFIG, file.Size());
+	LoadText((const char*)file.Data(), file.Size());
+	return true;
+}
+
+void ConfigValues::LoadText(const char* text, size_t length)
+{
+	m_Text.assign(text, length);
+	m_Entries.clear();
+
+	char* const start = m_Text.data();
+	char* const end = start + length;
+	for (char* line = start; line < end; )
+	{
+		char* lineEnd = (char*)memchr(line, '\n', end - line);
+		if (!lineEnd)
+		{
+			// The string's own terminator ends the last line
+			lineEnd = end;
+		}
+
+		char* delimiter = (char*)memchr(line, '=', lineEnd - line);
+		if (delimiter)
+		{
+			Entry entry;
+			entry.key = (uint32_t)(line - start);
+			entry.keyLength = (uint32_t)(delimiter - line);
+			entry.value = (uint32_t)(delimiter + 1 - start);
+			entry.valueLength = (uint32_t)(lineEnd - delimiter - 1);
+			m_Entries.push_back(entry);
+			*delimiter = '\0';
+		}
+		if (lineEnd < end)
+		{
+			*lineEnd = '\0';
+		}
+		line = lineEnd + 1;
+	}
+
+	// Equal keys stay in file order, so the last of each run is the one to keep
+	std::stable_sort(m_Entries.begin(), m_Entries.end(), [this](const Entry& a, const Entry& b) { return GetKey(a) < GetKey(b); });
+	size_t numKept = 0;
+	for (size_t i = 0; i < m_Entries.size(); ++i)
+	{
+		if (i + 1 < m_Entries.size() && GetKey(m_Entries[i]) == GetKey(m_Entries[i + 1]))
+		{
+			continue;
+		}
+		m_Entries[numKept++] = m_Entries[i];
+	}
+	m_Entries.resize(numKept);
+
+	// At most half full, so probe runs stay short
+	size_t numSlots = 16;
+	while (numSlots < m_Entries.size() * 2)
+	{
+		numSlots *= 2;
+	}
+	m_Slots.assign(numSlots, 0);
+	const size_t mask = numSlots - 1;
+	for (size_t i = 0; i < m_Entries.size(); ++i)
+	{
+		size_t slot = HashConfigKey(GetKey(m_Entries[i])) & mask;
+		while (m_Slots[slot])
+		{
+			slot = (slot + 1) & mask;
+		}
+		m_Slots[slot] = (uint32_t)(i + 1);
+	}
+}
+
+void ConfigValues::Clear()
+{
+	m_Text.clear();
+	m_Entries.clear();
+	m_Slots.clear();
+}
+
+std::string_view ConfigValues::GetKey(const Entry& entry) const
+{
+	return std::string_view(m_Text.data() + entry.key, entry.keyLength);
+}
+
+std::string_view ConfigValues::GetKey(size_t index) const
+{
+	return GetKey(m_Entries[index]);
+}
+
+std::string_view ConfigValues::GetValue(size_t index) const
+{
+	const Entry& entry = m_Entries[index];
+	return std::string_view(m_Text.data() + entry.value, entry.valueLength);
+}
+
+bool ConfigValues::Find(std::string_view key, size_t& indexOut) const
+{
+	if (m_Slots.empty())
+	{
+		return false;
+	}
 
-			configMap[key] = value;
+	const size_t mask = m_Slots.size() - 1;
+	for (size_t slot = HashConfigKey(key) & mask; m_Slots[slot]; slot = (slot + 1) & mask)
+	{
+		const size_t index = m_Slots[slot] - 1;
+		if (GetKey(m_Entries[index]) == key)
+		{
+			indexOut = index;
+			return true;
 		}
 	}
+	return false;
+}
+
+std::string_view ConfigValues::Get(std::string_view key, std::string_view defaultValue) const
+{
+	size_t index = 0;
+	return Find(key, index) ? GetValue(index) : defaultValue;
+}
+
+size_t ConfigValues::FindPrefix(std::string_view prefix, size_t& firstOut) const
+{
+	const auto first = std::lower_bound(m_Entries.begin(), m_Entries.end(), prefix,
+		[this](const Entry& entry, std::string_view key) { return GetKey(entry) < key; });
+	const auto last = std::partition_point(first, m_Entries.end(),
+		[this, prefix](const Entry& entry) { return GetKey(entry).starts_with(prefix); });
 
-	file.close();
+	firstOut = first - m_Entries.begin();
+	return last - first;
 }
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cinttypes>
 
+#include "microdraw_file.h"
+
 struct MD_Image;
+class Font;
 
 struct MD_Rect
 {
@@ -21,7 +27,104 @@ struct MD_Color
     uint8_t a;
 };
 
+bool md_intersect_rect(const MD_Rect& a, const MD_Rect& b, MD_Rect& out);
+MD_Rect md_union_rect(const MD_Rect& a, const MD_Rect& b);
+
+// Maximum number of separate changed regions tracked per frame. Further regions
+// get merged into whichever existing one grows the least.
+const int MD_MAX_DIRTY_RECTS = 16;
+
+// Collects the regions of the canvas touched since the last md_render(), so only
+// those need converting and pushing out to the display.
+class DirtyRectList
+{
+public:
+    void Add(const MD_Rect& rect);
+    void Clear();
+    bool IsEmpty() const { return m_Count == 0; }
+    int GetPixelCount() const;
+
+    MD_Rect m_Rects[MD_MAX_DIRTY_RECTS];
+    int m_Count = 0;
+};
+
+// Clip an unscaled blit the way SDL_BlitSurface does. src is the area of the image to
+// draw and dst gives its position. On return both hold the same, fully clipped, size.
+// Returns false if nothing would be drawn.
+bool md_clip_blit(int imageW, int imageH, const MD_Rect& clip, MD_Rect& src, MD_Rect& dst);
+
+// Clip the source of a scaled blit to the image the way SDL_BlitSurfaceScaled does. The
+// scale is kept, so the destination shrinks by the scaled amount cut off the source.
+// Returns false if nothing would be drawn.
+bool md_clip_scaled_source(int imageW, int imageH, MD_Rect& src, MD_Rect& dst);
+
+// A draw into the canvas, recorded for later when batching is enabled
+struct MD_DrawCommand
+{
+    enum Type : uint8_t
+    {
+        IMAGE,          // src and dst are already clipped, so draw without checks
+        IMAGE_SCALED,
+        FILL,
+        GLYPH           // Written from font's glyph mask, tinted by r, g, b
+    };
+
+    MD_Image* image = nullptr;
+    const Font* font = nullptr;
+    MD_Rect src = { 0, 0, 0, 0 };
+    MD_Rect dst = { 0, 0, 0, 0 };
+    MD_Rect clip = { 0, 0, 0, 0 };      // Canvas clip rect when the command was recorded
+    MD_Rect bounds = { 0, 0, 0, 0 };    // Area of the canvas written to
+    uint8_t type = IMAGE;
+    uint8_t r = 255;                    // Colour mod for images, colour for fills
+    uint8_t g = 255;
+    uint8_t b = 255;
+    bool opaque = false;                // Every pixel in bounds gets written, hiding what was beneath
+    uint16_t layer = 0;
+    uint32_t order = 0;
+};
+
+// Canvas draws collected over a frame. Before running them, commands hidden by later
+// opaque ones are dropped and the rest are grouped by image and state, only reordering
+// commands that don't overlap so the result is the same as drawing them as they came.
+class DrawCommandList
+{
+public:
+    void Add(const MD_DrawCommand& command);
+    void Clear();
+    bool IsEmpty() const { return m_Commands.empty(); }
+
+    // Cull and sort m_Commands into the order they should be executed in
+    void Prepare();
+
+    std::vector<MD_DrawCommand> m_Commands;
+    int m_NumCulled = 0;
+
+    // Indices of the commands touching each grid cell, kept to reuse the allocations
+    std::vector<std::vector<uint32_t>> m_Tiles;
+};
+
+struct MD_InitOptions
+{
+    // Draw into an RGB565 canvas rather than XRGB8888. Images get converted once when
+    // loaded and presenting to a 16-bit framebuffer becomes a straight copy.
+    bool rgb565_canvas = false;
+
+    // Draw into a hidden half of a double height framebuffer and pan to it once complete,
+    // avoiding tearing. Drivers without panning support fall back to a single buffer.
+    bool double_buffer_fb = true;
+
+    // When 2 or 3, finished canvases are handed to a background thread that pushes them
+    // to the framebuffer, so the next frame can be drawn meanwhile. 0 presents inline.
+    int present_thread_slots = 0;
+
+    // Record canvas draws and run them in one batch at md_render(), see DrawCommandList.
+    // Call md_flush_draws() before reading back from the canvas mid frame.
+    bool batch_draws = false;
+};
+
 bool md_init(int width, int height);
+bool md_init(int width, int height, const MD_InitOptions& options);
 void md_deinit();
 MD_Image* md_load_image(const char* filename);
 
@@ -30,6 +133,9 @@ MD_Image* md_load_image_with_key(const char* filename, uint8_t key_r, uint8_t ke
 MD_Image* md_load_image_from_565_data_with_key(const char* data, int width, int height, uint8_t key_r, uint8_t key_g, uint8_t key_b);
 MD_Image* md_load_image_from_565_data(const char* data, int width, int height);
 MD_Image* md_create_image(int w, int h);
+
+// Create an image in the canvas format, filled with the key colour so it starts out transparent
+MD_Image* md_create_image_with_key(int w, int h, uint8_t key_r, uint8_t key_g, uint8_t key_b);
 void md_destroy_image(MD_Image& image);
 void md_draw_pixel_to_image(MD_Image& image, int x, int y, uint8_t r, uint8_t g, uint8_t b);
 int md_get_image_width(const MD_Image& image);
@@ -39,26 +145,115 @@ bool md_draw_image(MD_Image& image, int x, int y);
 bool md_draw_image(MD_Image& image, MD_Rect& src, MD_Rect& dest);
 bool md_draw_image_scaled(MD_Image& image, MD_Rect& src, MD_Rect& dest);
 bool md_draw_image_scaled(MD_Image& image, MD_Rect& dest);
+
+// Draw into another image rather than the canvas when dest is set. Null rects mean the whole image.
+bool md_draw_image(MD_Image& image, MD_Rect* srcRect, MD_Image* dest, MD_Rect* destRect);
+bool md_draw_image_scaled(MD_Image& image, MD_Rect* srcRect, MD_Image* dest, MD_Rect* destRect);
 void md_filled_rect(MD_Rect& rect, uint8_t r, uint8_t g, uint8_t b);
 void md_set_image_clip(MD_Image& image, MD_Rect& rect);
 void md_set_clip(MD_Rect& rect);
 void md_clear_clip();
 void md_set_colour_mod(MD_Image& image, uint8_t key_r, uint8_t key_g, uint8_t key_b);
+void md_get_colour_mod(const MD_Image& image, uint8_t& r, uint8_t& g, uint8_t& b);
+
+// Direct access to an image's pixels, which are XRGB8888 or RGB565. Returns false for
+// other formats. Anything written this way isn't marked dirty.
+struct MD_PixelBuffer
+{
+    uint8_t* pixels = nullptr;
+    int pitch = 0;
+    int w = 0;
+    int h = 0;
+    bool rgb565 = false;
+    MD_Rect clip = { 0, 0, 0, 0 };
+};
+bool md_get_image_pixels(MD_Image& image, MD_PixelBuffer& out);
+
+// Draw src from the font's glyph mask into dst on the canvas, tinted by the colour mod of
+// the font's image. dst should be src scaled by a whole number. Needs Font::HasGlyphMask().
+void md_draw_glyph(const Font& font, const MD_Rect& src, const MD_Rect& dst);
+
+// Shared by the backends to write a glyph into target, clipped to target.clip
+void md_rasterise_glyph(const MD_PixelBuffer& target, const Font& font, const MD_Rect& src, const MD_Rect& dst, uint8_t r, uint8_t g, uint8_t b);
+
+// Drawing through the md_* calls marks the canvas dirty automatically. These are for
+// anything that changes the canvas some other way.
+void md_mark_dirty(const MD_Rect& rect);
+void md_mark_all_dirty();
+
+// Run any recorded draws now. Does nothing unless batching is enabled.
+void md_flush_draws();
+
 void md_render();
 bool md_exit_raised();
 
+struct MD_FrameTiming
+{
+    int target_fps = 0;         // 0 means unlimited
+    int idle_fps = 0;           // Rate used for frames that changed nothing, 0 means same as target
+    uint64_t frame_count = 0;
+    float last_frame_ms = 0.0f; // Time spent working on the last frame, excluding the pacing sleep
+    float min_frame_ms = 0.0f;
+    float max_frame_ms = 0.0f;
+    float avg_frame_ms = 0.0f;
+    float last_interval_ms = 0.0f; // Time from the start of the previous frame to the start of this one
+    bool idle = false;          // Whether the last frame was paced at the idle rate
+};
+
+// Frame pacing, applied at the end of md_render(). Sleeps until an absolute deadline
+// so the rate holds regardless of how long each frame took to draw.
+void md_set_target_fps(int fps);
+void md_set_idle_fps(int fps);
+MD_FrameTiming md_get_frame_timing();
+void md_reset_frame_timing();
+
+// Monotonic clock in nanoseconds
+int64_t md_time_ns();
+
+// Called by the backend once a frame has been presented. Sleeps until the frame's deadline.
+void md_pace_frame(bool idle);
+
 class Font
 {
 public:
     void InitFont(const char* bmpName, int glyphWidth, int glyphHeight);
     void InitFontFromImageData(const char* data, int w, int h, int glyphWidth, int glyphHeight);
+    // Measures each glyph so text can be drawn proportionally
     void MakeVariableWidth();
 
+    // Called when the font is loaded. If every lit pixel in the sheet is the same colour,
+    // keeps a coverage mask so glyphs can be written straight into the canvas.
+    void BuildGlyphMask();
+    bool HasGlyphMask() const { return !m_GlyphMask.empty(); }
+
+    // c is a cell of the sheet here, not a character, see FindGlyph
     int GetGlyphWidth(char c) const;
     int GetGlyphHeight(char c) const;
 
     MD_Rect GetGlpyphRect(char c) const;
 
+    // Rebuild the glyph tables from the sheet layout and glyph widths. Called when the
+    // font loads and by MakeVariableWidth.
+    void BuildMetrics();
+
+    // Read extra codepoint mappings and kerning pairs, replacing any read before. InitFont
+    // looks for one next to the sheet with a .glyphs extension, the format is described in
+    // LoadGlyphMap.
+    bool LoadGlyphMap(const char* filename);
+
+    // Glyph index for a codepoint, or -1 if the font can't show it. Accented Latin letters
+    // without a glyph of their own fall back to the plain letter.
+    int FindGlyph(uint32_t codepoint) const;
+
+    // Extra pen movement, before scaling, between two glyphs
+    int GetKerning(int leftGlyph, int rightGlyph) const;
+
+    // Width of a line of UTF-8 text in pixels, matching what draw_text draws
+    int GetTextWidth(const char* text, int scale) const;
+
+    // Find each glyph's left and right extents in the sheet, filling in m_GlyphData
+    void ScanGlyphBounds();
+
     MD_Image* m_Surface;
     int m_SpacingX = 0;
     int m_GlyphSurfaceW;
@@ -73,11 +268,104 @@ public:
         int width = 0;
     };
     GlyphData m_GlyphData[256];
+
+    // The sheets start at character 1, so cell n of the 16 column grid holds codepoint n + 1
+    static const uint32_t FIRST_CODEPOINT = 1;
+
+    struct GlyphMetrics
+    {
+        MD_Rect src;        // Area of the sheet to draw, bearing already applied
+        int advance;        // Pen movement before scaling, not counting m_SpacingX
+    };
+    std::vector<GlyphMetrics> m_Glyphs;             // Indexed by sheet cell
+    int16_t m_AsciiGlyphs[128] = {};                // Codepoint to glyph for the common case
+    std::vector<std::pair<uint32_t, uint16_t>> m_ExtraGlyphs;  // Sorted by codepoint
+    std::vector<std::pair<uint32_t, int8_t>> m_Kerning;        // Sorted by (left << 16) | right
+
+    std::vector<uint8_t> m_GlyphMask;   // One byte per sheet pixel, non-zero where lit
+    int m_GlyphMaskW = 0;
+    int m_GlyphMaskH = 0;
+    MD_Color m_GlyphInk = { 255, 255, 255, 255 };
 };
 
+// Read one codepoint from UTF-8 text and step past it. Bytes that aren't valid UTF-8 are
+// taken as Latin-1 so older text still shows.
+uint32_t md_decode_utf8(const char*& text);
+
 void draw_text(Font& font, int x, int y, const char* text, int scale);
 void draw_num(Font& font, int x, int y, const char* text, int scale);
 
+// Same as draw_text, but the whole string is rendered once into an image and reused on
+// later calls, so it costs one blit rather than one per glyph. Suits strings that stay
+// the same for many frames. The font's colour mod is applied when the run is drawn.
+void draw_text_cached(Font& font, int x, int y, const char* text, int scale);
+
+struct MD_TextCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    uint32_t entries = 0;
+    size_t bytes = 0;
+    size_t limit_bytes = 0;
+};
+
+// Least recently used runs are dropped once the cache grows past the limit
+const size_t MD_DEFAULT_TEXT_CACHE_BYTES = 256 * 1024;
+void md_set_text_cache_limit(size_t bytes);
+MD_TextCacheStats md_get_text_cache_stats();
+
+// Cached runs refer to their font, so clear the cache before destroying a font's image
+void md_clear_text_cache();
+
+// Text wrapped to a width in pixels, measured with the font's own advances and kerning.
+// Lines break after spaces where possible and mid-word only when a word is too long for
+// a line of its own, '\n' always starts a new line. The result is kept until the text,
+// width, scale or font change, so calling Layout every frame with the same text is cheap.
+class TextLayout
+{
+public:
+    struct Line
+    {
+        std::string text;       // The line's UTF-8 text, without the spaces it broke at
+        int y = 0;              // Offset from the top of the layout
+        int width = 0;          // Matches Font::GetTextWidth for the line
+        uint32_t firstGlyph = 0;
+        uint32_t numGlyphs = 0;
+    };
+
+    // A glyph placed relative to the layout's top left
+    struct Glyph
+    {
+        uint16_t index;         // Into Font::m_Glyphs
+        int16_t x;
+        int16_t y;
+    };
+
+    // Returns true if the text had to be laid out again
+    bool Layout(Font& font, const char* text, int maxWidth, int scale = 1);
+    void Clear();
+
+    // Draw the lines that fit within maxHeight pixels, or all of them for 0. Each line is
+    // drawn as a cached run, see draw_text_cached.
+    void Draw(int x, int y, int maxHeight = 0) const;
+
+    int GetLineHeight() const;
+
+    Font* m_Font = nullptr;
+    std::string m_Text;
+    int m_MaxWidth = 0;
+    int m_Scale = 1;
+    int m_SpacingX = 0;         // Font settings the layout was measured with
+    bool m_Monospace = true;
+
+    int m_Width = 0;            // Widest line
+    int m_Height = 0;
+    std::vector<Line> m_Lines;
+    std::vector<Glyph> m_Glyphs;
+    uint32_t m_NumLayouts = 0;  // Times the text was actually wrapped
+};
+
 
 
 class PanningImage
@@ -136,6 +424,73 @@ MD_Color HSLToSDLColor(float h, float s, float l, uint8_t a = 255);
 int LerpInt(float t, int from, int to);
 
 
+struct MD_JSONArenaStats
+{
+    size_t capacity_bytes = 0;
+    size_t used_bytes = 0;      // Including any overflow
+    size_t peak_bytes = 0;      // Most ever used by one document, size the arena from this
+    size_t overflow_bytes = 0;  // Currently taken from the heap because the arena was full
+    uint32_t resets = 0;
+};
+
+// Fixed-size block that a JSON document's nodes are bump allocated from. Nothing is freed
+// on its own; Reset() drops everything at once and the block gets reused. Anything that
+// doesn't fit comes from the heap and is released on the next Reset().
+class JSONArena : public std::pmr::memory_resource
+{
+public:
+    explicit JSONArena(size_t capacityBytes);
+    ~JSONArena();
+    JSONArena(const JSONArena&) = delete;
+    JSONArena& operator=(const JSONArena&) = delete;
+
+    void Reset();
+    const MD_JSONArenaStats& GetStats() const { return m_Stats; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    struct Overflow
+    {
+        void* memory;
+        size_t bytes;
+        size_t alignment;
+    };
+
+    std::unique_ptr<uint8_t[]> m_Block;
+    size_t m_Offset = 0;
+    std::vector<Overflow> m_Overflow;
+    MD_JSONArenaStats m_Stats;
+};
+
+// A path to a value, such as "daily.temperature_2m_min[0]", split up once so it can be
+// looked up again and again without reparsing it. Member names are joined by dots and
+// array indices go in brackets, the same form JSONStream binds.
+class JSONPath
+{
+public:
+    struct Step
+    {
+        std::string name;
+        int index = -1;         // Set for an array element, otherwise name is a member
+    };
+
+    JSONPath() = default;
+    explicit JSONPath(const char* path);
+
+    // False for a malformed path, which never finds anything
+    bool IsValid() const { return m_Valid; }
+
+    std::vector<Step> m_Steps;
+    bool m_Valid = false;
+};
+
+struct JSONVal;
+typedef std::pmr::map<std::pmr::string, JSONVal*, std::less<>> JSONObject;
+typedef std::pmr::vector<JSONVal*> JSONArray;
+
 struct JSONVal
 {
     ~JSONVal()
@@ -145,15 +500,30 @@ struct JSONVal
 
     void Reset();
 
+    // Build this document in an arena rather than with a heap allocation per node. Each
+    // parse into the document rewinds the arena, so the old tree is dropped in one go and
+    // its memory reused. Only call on the root value.
+    void UseArena(size_t capacityBytes);
+    const JSONArena* GetArena() const { return m_Arena.get(); }
+
     const JSONVal& GetObject(const char* name) const;
     const JSONVal& GetArrayVal(int index) const;
+    const JSONVal& Get(const JSONPath& path) const;
     int GetAsInt() const;
     float GetAsFloat() const;
     const char* GetAsString() const;
 
-    std::map<std::string, JSONVal*>* m_object = nullptr;
-    std::string* m_value = nullptr;
-    std::vector<JSONVal*>* m_array = nullptr;
+    JSONObject* m_object = nullptr;
+    std::pmr::string* m_value = nullptr;
+    JSONArray* m_array = nullptr;
+
+    // Numbers are converted as they're parsed, GetAsInt and GetAsFloat return these
+    bool m_isNumber = false;
+    int m_asInt = -1;
+    float m_asFloat = 0.0f;
+
+    // Set on an arena backed root, its children are all in the arena
+    std::unique_ptr<JSONArena> m_Arena;
 
 protected:
     static JSONVal Invalid;
@@ -162,8 +532,265 @@ protected:
 bool ParseJSON(const char* json, JSONVal& jsonDocOut);
 bool ParseJSONFile(const char* filename, JSONVal& jsonDocOut);
 
+class JSONTape;
+
+// A value in a JSONTape, with the same accessors as JSONVal. Cheap to copy, and only
+// valid until the tape is parsed into again.
+class JSONTapeVal
+{
+public:
+    JSONTapeVal() = default;
+    JSONTapeVal(const JSONTape* tape, uint32_t index) : m_Tape(tape), m_Index(index) {}
+
+    bool IsValid() const { return m_Tape != nullptr; }
+    bool IsObject() const;
+    bool IsArray() const;
+
+    const JSONTapeVal GetObject(const char* name) const;
+    const JSONTapeVal GetArrayVal(int index) const;
+    const JSONTapeVal Get(const JSONPath& path) const;
+    int GetAsInt() const;
+    float GetAsFloat() const;
+    const char* GetAsString() const;
+
+    // Members of an object or elements of an array
+    int GetCount() const;
+
+    // Name of this value when it's an object member, and the text of a string or number
+    std::string_view GetKey() const;
+    std::string_view GetView() const;
+
+private:
+    const JSONTape* m_Tape = nullptr;
+    uint32_t m_Index = 0;
+};
+
+// Compact alternative to JSONVal. Every value is a fixed-size node in one array, in
+// document order, with each object or array followed by its children. Member names,
+// strings and numbers are views into the document's text, which is unescaped and
+// terminated in place, so a reparse reuses both allocations. Parsing is two passes, as in
+// simdjson: md_json_index finds every token with vector compares, then the nodes are built
+// from that list without looking at whitespace or string contents again.
+// A key repeated within an object stays in the tape, and GetCount counts it each time,
+// but looking it up finds its last value, the one a JSONVal keeps.
+class JSONTape
+{
+public:
+    enum Type : uint8_t
+    {
+        OBJECT,
+        ARRAY,
+        STRING,
+        NUMBER
+    };
+
+    struct Node
+    {
+        uint8_t type = OBJECT;
+        uint32_t next = 0;          // One past the last node of this value, its next sibling
+        uint32_t count = 0;         // Members or elements
+        uint32_t key = 0;           // Offset of the member name in the text, for object members
+        uint32_t keyLength = 0;
+        uint32_t value = 0;         // Offset of a string or number in the text
+        uint32_t valueLength = 0;
+        int32_t intValue = -1;      // Numbers, converted while parsing
+        float floatValue = 0.0f;
+    };
+
+    // Copies json into the tape's own buffer before parsing
+    bool Parse(const char* json);
+
+    // Parses json where it is, writing unescaped strings and terminators into it. The
+    // text must stay alive and unchanged for as long as the tape is used.
+    // The length, when given, saves a strlen. There must still be a terminator after it.
+    bool ParseInSitu(char* json);
+    bool ParseInSitu(char* json, size_t length);
+
+    void Clear();
+
+    JSONTapeVal GetRoot() const;
+
+    // Same as going through GetRoot(), so a tape can stand in for a JSONVal document
+    const JSONTapeVal GetObject(const char* name) const { return GetRoot().GetObject(name); }
+    const JSONTapeVal GetArrayVal(int index) const { return GetRoot().GetArrayVal(index); }
+    const JSONTapeVal Get(const JSONPath& path) const { return GetRoot().Get(path); }
+
+    std::vector<Node> m_Nodes;
+    std::string m_Buffer;       // Holds the text for Parse
+    MD_MappedFile m_File;       // Holds the text read by ParseJSONFile
+    const char* m_Text = nullptr;
+    std::vector<uint32_t> m_Indices;    // Offsets of the document's tokens, from md_json_index
+
+    // Set by ParseJSONFile, which reads the file into m_File and skips files that
+    // haven't changed since it last read them
+    MD_FileSource m_Source;
+
+private:
+    bool ParseValue(size_t& token, uint32_t key, uint32_t keyLength);
+    bool ParseString(uint32_t quote, uint32_t& offset, uint32_t& length);
+
+    // The text being parsed, only set during ParseInSitu
+    char* m_ParseText = nullptr;
+    char* m_ParseEnd = nullptr;
+};
+
+// Parse a file into a tape, reading it into the tape's buffer. The tape's views outlive
+// the call, so the file isn't mapped where a rewrite could change them later. If the
+// file's size and timestamp are the same as when tapeOut last loaded it, nothing is read
+// and the previous result stands.
+// changedOut, if given, says whether the tape's contents were replaced.
+bool ParseJSONFile(const char* filename, JSONTape& tapeOut, bool* changedOut = nullptr);
+
+// Receives a JSONStream's events in document order. Keys and strings are unescaped and
+// numbers are given as their text. The views are only valid during the call.
+class JSONHandler
+{
+public:
+    virtual ~JSONHandler() = default;
+
+    virtual void OnBeginObject() {}
+    virtual void OnEndObject() {}
+    virtual void OnBeginArray() {}
+    virtual void OnEndArray() {}
+    virtual void OnKey(std::string_view /*key*/) {}
+    virtual void OnString(std::string_view /*value*/) {}
+    virtual void OnNumber(std::string_view /*text*/) {}
+};
+
+// Parses JSON a chunk at a time without building a document. Values are passed to a
+// JSONHandler as they complete, and values at bound paths are converted straight into the
+// caller's variables. Memory use depends on how deep the document nests and its longest
+// string, not on its size.
+class JSONStream
+{
+public:
+    // Paths are member names joined by dots with array indices in brackets, the same as
+    // they'd be written in code: "daily.temperature_2m_min[0]". A bound variable is only
+    // written when its value turns up, and bindings stay until ClearBindings().
+    void Bind(const char* path, int& out);
+    void Bind(const char* path, float& out);
+    void Bind(const char* path, std::string& out);
+    void ClearBindings();
+
+    void SetHandler(JSONHandler* handler) { m_Handler = handler; }
+
+    // Start a new document, give it to Feed in pieces of any size, then End() says whether
+    // it was one complete value. Feed returns false once the text can't be JSON.
+    void Begin();
+    bool Feed(const char* data, size_t size);
+    bool End();
+
+    // Number of bound values written since Begin()
+    int GetNumFound() const { return m_NumFound; }
+
+    // Set by ParseJSONFile, which skips files that haven't changed since it last read them
+    MD_FileSource m_Source;
+
+private:
+    enum State : uint8_t
+    {
+        VALUE,          // Before a value, or the end of an array
+        KEY,            // Before a member name, or the end of an object
+        COLON,
+        AFTER_VALUE,    // Before a comma or the end of the container
+        STRING,
+        STRING_ESCAPE,
+        NUMBER,
+        DONE,           // The root value is complete, anything after it is ignored
+        FAILED
+    };
+
+    enum BindingType : uint8_t
+    {
+        BIND_INT,
+        BIND_FLOAT,
+        BIND_STRING
+    };
+
+    struct Binding
+    {
+        std::string path;
+        BindingType type = BIND_INT;
+        void* out = nullptr;
+    };
+
+    // An open object or array
+    struct Scope
+    {
+        bool isObject = false;
+        uint32_t count = 0;         // Members or elements so far
+        size_t pathLength = 0;      // Length of m_Path for the container itself
+    };
+
+    void AddBinding(const char* path, BindingType type, void* out);
+    void BeginValue();
+    void BeginContainer(bool isObject);
+    bool EndContainer(bool isObject);
+    void EndString();
+    void EndNumber();
+    void EndValue();
+    void SetBoundValues();
+
+    std::vector<Binding> m_Bindings;
+    JSONHandler* m_Handler = nullptr;
+
+    State m_State = VALUE;
+    bool m_StringIsKey = false;
+    std::vector<Scope> m_Scopes;
+    std::string m_Path;         // Path of the current value, in the same form as bindings
+    std::string m_Token;        // The string or number being read, which can span chunks
+    int m_NumFound = 0;
+};
+
+// Stream a file through a JSONStream in small chunks. Files that haven't changed since
+// the stream last read them are skipped the same way as for a JSONTape.
+bool ParseJSONFile(const char* filename, JSONStream& streamOut, bool* changedOut = nullptr);
+
 
 
 
 typedef std::map<std::string, std::string> Values;
-void LoadConfigToMap(const char* filename, Values& configMap);
\ No newline at end of file
+void LoadConfigToMap(const char* filename, Values& configMap);
+// Same as LoadConfigToMap for text that's already in memory
+void LoadConfigText(const char* text, size_t length, Values& configMap);
+
+// The same key=value lines as LoadConfigToMap, without a tree node and two strings per
+// value. The text is copied into one buffer, with a terminator written over each '=' and
+// line end, and the values are kept in key order. Lookups go through an open addressing
+// hash table of the keys, and because of the ordering every key with a given prefix is
+// in one run. A key given more than once keeps its last value, as in Values.
+class ConfigValues
+{
+public:
+    bool Load(const char* filename);
+    void LoadText(const char* text, size_t length);
+    void Clear();
+
+    size_t GetNumValues() const { return m_Entries.size(); }
+
+    // By index, in key order. Both are terminated, so data() can be used as a C string.
+    std::string_view GetKey(size_t index) const;
+    std::string_view GetValue(size_t index) const;
+
+    bool Find(std::string_view key, size_t& indexOut) const;
+    std::string_view Get(std::string_view key, std::string_view defaultValue = {}) const;
+
+    // The keys starting with prefix are the count returned from firstOut on
+    size_t FindPrefix(std::string_view prefix, size_t& firstOut) const;
+
+private:
+    // Offsets into m_Text, so a copy doesn't point into the original
+    struct Entry
+    {
+        uint32_t key = 0;
+        uint32_t keyLength = 0;
+        uint32_t value = 0;
+        uint32_t valueLength = 0;
+    };
+
+    std::string_view GetKey(const Entry& entry) const;
+
+    std::string m_Text;
+    std::vector<Entry> m_Entries;
+    std::vector<uint32_t> m_Slots;  // Entry index + 1, or 0 for empty. A power of two long.
+};
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "microdraw_convert.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MD_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MD_CONVERT_SSE2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define MD_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MD_TARGET_AVX2
+#endif
+
+static inline uint16_t ConvertPixel(uint32_t c)
+{
+    return (uint16_t)(((c >> 8) & 0xF800) | ((c >> 5) & 0x07E0) | ((c >> 3) & 0x001F));
+}
+
+static void ConvertRowScalar(const uint32_t* src, uint16_t* dst, int count)
+{
+    for (int x = 0; x < count; ++x)
+    {
+        dst[x] = ConvertPixel(src[x]);
+    }
+}
+
+#ifdef MD_CONVERT_SSE2
+static inline __m128i Pack565SSE2(__m128i c)
+{
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(c, 8), _mm_set1_epi32(0xF800));
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(c, 5), _mm_set1_epi32(0x07E0));
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001F));
+    const __m128i rgb = _mm_or_si128(_mm_or_si128(r, g), b);
+
+    // SSE2 only has a signed 32->16 pack, so sign extend the low half first to
+    // stop values with the top red bit set from saturating
+    return _mm_srai_epi32(_mm_slli_epi32(rgb, 16), 16);
+}
+
+static void ConvertRowSSE2(const uint32_t* src, uint16_t* dst, int count)
+{
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        const __m128i lo = Pack565SSE2(_mm_loadu_si128((const __m128i*)(src + x)));
+        const __m128i hi = Pack565SSE2(_mm_loadu_si128((const __m128i*)(src + x + 4)));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packs_epi32(lo, hi));
+    }
+    ConvertRowScalar(src + x, dst + x, count - x);
+}
+#endif
+
+#ifdef MD_CONVERT_X86
+MD_TARGET_AVX2 static inline __m256i Pack565AVX2(__m256i c)
+{
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(c, 8), _mm256_set1_epi32(0xF800));
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 5), _mm256_set1_epi32(0x07E0));
+    const __m256i b = _mm256_and_si256(_mm256_srli_epi32(c, 3), _mm256_set1_epi32(0x001F));
+    return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+MD_TARGET_AVX2 static void ConvertRowAVX2(const uint32_t* src, uint16_t* dst, int count)
+{
+    int x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        const __m256i lo = Pack565AVX2(_mm256_loadu_si256((const __m256i*)(src + x)));
+        const __m256i hi = Pack565AVX2(_mm256_loadu_si256((const __m256i*)(src + x + 8)));
+
+        // The pack works per 128-bit lane, so put the quarters back in pixel order
+        const __m256i packed = _mm256_packus_epi32(lo, hi);
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    ConvertRowScalar(src + x, dst + x, count - x);
+}
+
+static bool CpuHasAVX2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef MD_CONVERT_NEON
+static void ConvertRowNEON(const uint32_t* src, uint16_t* dst, int count)
+{
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        // XRGB8888 is stored B, G, R, X in memory so this splits out each channel
+        const uint8x8x4_t c = vld4_u8((const uint8_t*)(src + x));
+
+        // Shift each channel to the top of a 16-bit lane and insert the next one below it
+        uint16x8_t rgb = vshll_n_u8(c.val[2], 8);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(c.val[1], 8), 5);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(c.val[0], 8), 11);
+        vst1q_u16(dst + x, rgb);
+    }
+    ConvertRowScalar(src + x, dst + x, count - x);
+}
+#endif
+
+MD_ConvertRowFunc md_get_convert_row_func(MD_ConvertPath path)
+{
+    switch (path)
+    {
+    case MD_ConvertPath::Scalar:
+        return ConvertRowScalar;
+#ifdef MD_CONVERT_SSE2
+    case MD_ConvertPath::SSE2:
+        return ConvertRowSSE2;
+#endif
+#ifdef MD_CONVERT_X86
+    case MD_ConvertPath::AVX2:
+        return CpuHasAVX2() ? ConvertRowAVX2 : nullptr;
+#endif
+#ifdef MD_CONVERT_NEON
+    case MD_ConvertPath::NEON:
+        return ConvertRowNEON;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+MD_ConvertPath md_get_best_convert_path()
+{
+    // Worked out once, the CPU isn't going to change under us
+    static const MD_ConvertPath best = []()
+    {
+        const MD_ConvertPath preferred[] = { MD_ConvertPath::AVX2, MD_ConvertPath::NEON, MD_ConvertPath::SSE2 };
+        for (MD_ConvertPath path : preferred)
+        {
+            if (md_get_convert_row_func(path))
+            {
+                return path;
+            }
+        }
+        return MD_ConvertPath::Scalar;
+    }();
+    return best;
+}
+
+const char* md_get_convert_path_name(MD_ConvertPath path)
+{
+    switch (path)
+    {
+    case MD_ConvertPath::Scalar: return "scalar";
+    case MD_ConvertPath::SSE2:   return "sse2";
+    case MD_ConvertPath::AVX2:   return "avx2";
+    case MD_ConvertPath::NEON:   return "neon";
+    default:                     return "unknown";
+    }
+}
+
+void md_convert_row_xrgb8888_to_rgb565(const uint32_t* src, uint16_t* dst, int count)
+{
+    static const MD_ConvertRowFunc convert = md_get_convert_row_func(md_get_best_convert_path());
+    convert(src, dst, count);
+}
+
+void md_convert_xrgb8888_to_rgb565(const void* src, int srcPitch, void* dst, int dstPitch, int w, int h)
+{
+    const uint8_t* srcRow = (const uint8_t*)src;
+    uint8_t* dstRow = (uint8_t*)dst;
+    for (int y = 0; y < h; ++y)
+    {
+        md_convert_row_xrgb8888_to_rgb565((const uint32_t*)srcRow, (uint16_t*)dstRow, w);
+        srcRow += srcPitch;
+        dstRow += dstPitch;
+    }
+}
+
+void md_or_accumulate(uint8_t* acc, const uint8_t* src, int bytes)
+{
+    int i = 0;
+#if defined(MD_CONVERT_SSE2)
+    for (; i + 16 <= bytes; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(acc + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_or_si128(a, b));
+    }
+#elif defined(MD_CONVERT_NEON)
+    for (; i + 16 <= bytes; i += 16)
+    {
+        vst1q_u8(acc + i, vorrq_u8(vld1q_u8(acc + i), vld1q_u8(src + i)));
+    }
+#endif
+    for (; i < bytes; ++i)
+    {
+        acc[i] |= src[i];
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cinttypes>
+
+// Pixel format conversion kernels used when pushing the canvas out to a 16-bit display,
+// plus other small per-row pixel kernels. Every path produces identical output, the fastest
+// one the CPU supports is picked at runtime.
+
+enum class MD_ConvertPath
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    NEON,
+    Count
+};
+
+// Convert `count` XRGB8888 pixels to RGB565
+typedef void (*MD_ConvertRowFunc)(const uint32_t* src, uint16_t* dst, int count);
+
+// Returns nullptr if the path isn't compiled in or the CPU doesn't support it
+MD_ConvertRowFunc md_get_convert_row_func(MD_ConvertPath path);
+MD_ConvertPath md_get_best_convert_path();
+const char* md_get_convert_path_name(MD_ConvertPath path);
+
+// Convert one row using the best available path
+void md_convert_row_xrgb8888_to_rgb565(const uint32_t* src, uint16_t* dst, int count);
+
+// Convert a w*h block, with pitches given in bytes
+void md_convert_xrgb8888_to_rgb565(const void* src, int srcPitch, void* dst, int dstPitch, int w, int h);
+
+// acc[i] |= src[i] for `bytes` bytes. ORing every row of a band of pixels together shows
+// which columns have anything set in them.
+void md_or_accumulate(uint8_t* acc, const uint8_t* src, int bytes);
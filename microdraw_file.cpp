@@ -0,0 +1,531 @@
+#include "microdraw_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool md_get_file_info(const char* filename, MD_FileInfo& infoOut)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return false;
+    }
+    infoOut.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    infoOut.mtime = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+#else
+    // One stat() rather than separate size and time queries
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+    infoOut.size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+    infoOut.mtime = ((int64_t)st.st_mtimespec.tv_sec * 1000000000) + st.st_mtimespec.tv_nsec;
+#else
+    infoOut.mtime = ((int64_t)st.st_mtim.tv_sec * 1000000000) + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+bool MD_FileSource::IsUnchanged(const char* filename, const MD_FileInfo& info) const
+{
+    return m_Remembered && m_Filename == filename && info.size == m_Info.size && info.mtime == m_Info.mtime;
+}
+
+void MD_FileSource::Remember(const char* filename, const MD_FileInfo& info, bool succeeded)
+{
+    m_Filename = filename;
+    m_Info = info;
+    m_Remembered = true;
+    m_Succeeded = succeeded;
+}
+
+void MD_FileSource::Forget()
+{
+    m_Remembered = false;
+    m_Succeeded = false;
+}
+
+MD_MappedFile::~MD_MappedFile()
+{
+    Close();
+}
+
+bool MD_MappedFile::Open(const char* filename)
+{
+    return OpenFile(filename, false, true);
+}
+
+bool MD_MappedFile::OpenCopyOnWrite(const char* filename)
+{
+    return OpenFile(filename, true, true);
+}
+
+bool MD_MappedFile::Read(const char* filename)
+{
+    return OpenFile(filename, true, false);
+}
+
+size_t MD_MappedFile::GetPageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// The platform's handle to an open file, so reading and mapping open files the same way
+#ifdef _WIN32
+typedef HANDLE FileHandle;
+#else
+typedef int FileHandle;
+#endif
+
+static bool OpenForRead(const char* filename, FileHandle& fileOut, size_t& sizeOut)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    fileOut = file;
+    sizeOut = (size_t)fileSize.QuadPart;
+#else
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    fileOut = fd;
+    sizeOut = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+// Read up to n bytes to dst. Returns how many, 0 at the end of the file or -1 on error.
+static long long ReadSome(FileHandle file, uint8_t* dst, size_t n)
+{
+#ifdef _WIN32
+    DWORD got = 0;
+    return ReadFile(file, dst, (DWORD)std::min(n, (size_t)0x40000000), &got, nullptr) ? (long long)got : -1;
+#else
+    return (long long)read(file, dst, n);
+#endif
+}
+
+static void CloseFile(FileHandle file)
+{
+#ifdef _WIN32
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+}
+
+// Read to the end of a file into buffer, reusing its capacity, then add the trailing zero
+static bool ReadAll(std::vector<uint8_t>& buffer, size_t expectedSize, FileHandle file, size_t& sizeOut)
+{
+    buffer.resize(std::max(buffer.capacity(), expectedSize + 1));
+    size_t size = 0;
+    while (true)
+    {
+        if (size == buffer.size())
+        {
+            // The file grew since it was measured
+            buffer.resize(buffer.size() * 2);
+        }
+        const long long read = ReadSome(file, buffer.data() + size, buffer.size() - size);
+        if (read < 0)
+        {
+            buffer.clear();
+            return false;
+        }
+        if (read == 0)
+        {
+            break;
+        }
+        size += (size_t)read;
+    }
+
+    buffer.resize(size + 1);
+    buffer[size] = 0;
+    sizeOut = size;
+    return true;
+}
+
+bool MD_MappedFile::OpenFile(const char* filename, bool copyOnWrite, bool allowMapping)
+{
+    Close();
+
+    FileHandle file;
+    size_t size = 0;
+    if (!OpenForRead(filename, file, size))
+    {
+        return false;
+    }
+
+    // Copy-on-write views promise a zero after the text. Past the end of the file the rest of
+    // its last page reads as zero, but there's no such byte when the file fills it exactly.
+    if (allowMapping && size >= MD_MIN_MAPPED_BYTES && (!copyOnWrite || size % GetPageSize() != 0))
+    {
+#ifdef _WIN32
+        HANDLE mapping = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view)
+        {
+            m_File = file;
+            m_Mapping = mapping;
+            m_Data = (uint8_t*)view;
+            m_Size = size;
+            m_Mapped = true;
+        }
+        else if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+#else
+        // MAP_PRIVATE makes writes copy the page rather than reach the file
+        void* view = mmap(nullptr, size, copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE, file, 0);
+        if (view != MAP_FAILED)
+        {
+            m_Data = (uint8_t*)view;
+            m_Size = size;
+            m_Mapped = true;
+        }
+#endif
+    }
+    if (!m_Mapped)
+    {
+        const bool read = ReadAll(m_Buffer, size, file, m_Size);
+        CloseFile(file);
+        if (!read)
+        {
+            return false;
+        }
+        m_Data = m_Buffer.data();
+    }
+#ifndef _WIN32
+    else
+    {
+        // A mapping keeps its own reference to the file
+        CloseFile(file);
+    }
+#endif
+
+    m_Open = true;
+    m_Writable = copyOnWrite;
+    return true;
+}
+
+bool md_read_file_chunks(const char* filename, void* chunk, size_t chunkBytes, const std::function<bool(const void* data, size_t size)>& func)
+{
+    FileHandle file;
+    size_t size = 0;
+    if (!OpenForRead(filename, file, size))
+    {
+        return false;
+    }
+
+    long long read = 0;
+    while ((read = ReadSome(file, (uint8_t*)chunk, chunkBytes)) > 0 && func(chunk, (size_t)read))
+    {
+    }
+    CloseFile(file);
+    return read >= 0;
+}
+
+void MD_MappedFile::Close()
+{
+    if (m_Mapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_Data);
+        CloseHandle((HANDLE)m_Mapping);
+        CloseHandle((HANDLE)m_File);
+        m_Mapping = nullptr;
+        m_File = nullptr;
+#else
+        munmap(m_Data, m_Size);
+#endif
+    }
+    m_Buffer.clear();
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Open = false;
+    m_Mapped = false;
+    m_Writable = false;
+}
+
+// XXH64, as described at https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Loads are memcpy'd so unaligned input is fine. Assumes a little-endian host, like
+// everything else that reads files here.
+static inline uint64_t Read64(const uint8_t* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = RotateLeft(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= Round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t md_hash64(const void* data, size_t bytes, uint64_t seed)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* const end = p + bytes;
+    uint64_t hash;
+
+    if (bytes >= 32)
+    {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const uint8_t* const limit = end - 32;
+        do
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        hash = MergeRound(hash, v1);
+        hash = MergeRound(hash, v2);
+        hash = MergeRound(hash, v3);
+        hash = MergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + PRIME64_5;
+    }
+
+    hash += (uint64_t)bytes;
+
+    while (p + 8 <= end)
+    {
+        hash ^= Round(0, Read64(p));
+        hash = RotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        hash ^= (uint64_t)Read32(p) * PRIME64_1;
+        hash = RotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        hash ^= (uint64_t)(*p) * PRIME64_5;
+        hash = RotateLeft(hash, 11) * PRIME64_1;
+        ++p;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+bool md_write_file_atomic(const char* filename, const void* data, size_t bytes)
+{
+    const std::string tempName = std::string(filename) + ".tmp";
+    FILE* file = fopen(tempName.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    const bool written = fwrite(data, 1, bytes, file) == bytes;
+    const bool closed = fclose(file) == 0;
+    std::error_code error;
+    if (!written || !closed)
+    {
+        std::filesystem::remove(tempName, error);
+        return false;
+    }
+    std::filesystem::rename(tempName, filename, error);
+    if (error)
+    {
+        std::filesystem::remove(tempName, error);
+        return false;
+    }
+    return true;
+}
+
+int MD_DataSources::Subscribe(const char* filename, MD_DataChangedFunc func)
+{
+    auto found = std::find_if(m_Sources.begin(), m_Sources.end(),
+        [filename](const Source& source) { return source.filename == filename; });
+    if (found == m_Sources.end())
+    {
+        found = m_Sources.insert(m_Sources.end(), Source());
+        found->filename = filename;
+    }
+
+    Subscriber subscriber;
+    subscriber.id = m_NextId++;
+    subscriber.func = std::move(func);
+    found->subscribers.push_back(std::move(subscriber));
+    return found->subscribers.back().id;
+}
+
+void MD_DataSources::Unsubscribe(int id)
+{
+    for (size_t i = 0; i < m_Sources.size(); ++i)
+    {
+        std::vector<Subscriber>& subscribers = m_Sources[i].subscribers;
+        subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+            [id](const Subscriber& subscriber) { return subscriber.id == id; }), subscribers.end());
+        if (subscribers.empty())
+        {
+            m_Sources.erase(m_Sources.begin() + i);
+            return;
+        }
+    }
+}
+
+int MD_DataSources::Poll()
+{
+    int changed = 0;
+    for (size_t i = 0; i < m_Sources.size(); ++i)
+    {
+        changed += PollSource(m_Sources[i]) ? 1 : 0;
+    }
+    return changed;
+}
+
+bool MD_DataSources::Poll(const char* filename)
+{
+    for (Source& source : m_Sources)
+    {
+        if (source.filename == filename)
+        {
+            return PollSource(source);
+        }
+    }
+    return false;
+}
+
+bool MD_DataSources::PollSource(Source& source)
+{
+    m_Stats.checks++;
+
+    // A file that goes missing keeps its last contents, and counts as new when it's back
+    MD_FileInfo info;
+    if (!md_get_file_info(source.filename.c_str(), info))
+    {
+        source.file.Forget();
+        return false;
+    }
+
+    const bool allNotified = std::all_of(source.subscribers.begin(), source.subscribers.end(),
+        [](const Subscriber& subscriber) { return subscriber.notified; });
+    if (allNotified && source.file.IsUnchanged(source.filename.c_str(), info))
+    {
+        return false;
+    }
+
+    if (!m_File.OpenCopyOnWrite(source.filename.c_str()))
+    {
+        source.file.Forget();
+        return false;
+    }
+    m_Stats.reads++;
+
+    const uint64_t hash = md_hash64(m_File.Data(), m_File.Size());
+    const bool changed = !source.file.IsRemembered() || hash != source.hash;
+    source.file.Remember(source.filename.c_str(), info, true);
+    source.hash = hash;
+    if (!changed)
+    {
+        m_Stats.same_contents++;
+    }
+    else
+    {
+        m_Stats.changes++;
+    }
+
+    // Work from a copy, a subscriber is free to subscribe or unsubscribe from its callback.
+    // Subscribers added since the last read get the contents even when they haven't changed.
+    std::vector<Subscriber> subscribers = source.subscribers;
+    for (Subscriber& subscriber : source.subscribers)
+    {
+        subscriber.notified = true;
+    }
+    const char* text = (const char*)m_File.Data();
+    const size_t size = m_File.Size();
+    for (const Subscriber& subscriber : subscribers)
+    {
+        if (changed || !subscriber.notified)
+        {
+            subscriber.func(text, size);
+        }
+    }
+    return changed;
+}
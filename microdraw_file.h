@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// File helpers shared by the loaders: cheap change checks, read-only whole-file views
+// and content hashing.
+
+struct MD_FileInfo
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;      // Only meaningful for comparing against another MD_FileInfo
+};
+
+// False if the file doesn't exist
+bool md_get_file_info(const char* filename, MD_FileInfo& infoOut);
+
+// The file a loader last read, with its size and timestamp at the time, so the loader can
+// skip it until either changes. The result of the read is kept even when it failed, so a
+// broken file isn't read again until it changes either.
+class MD_FileSource
+{
+public:
+    // True if filename is the file remembered and info matches what it was then
+    bool IsUnchanged(const char* filename, const MD_FileInfo& info) const;
+
+    void Remember(const char* filename, const MD_FileInfo& info, bool succeeded);
+    void Forget();
+
+    bool IsRemembered() const { return m_Remembered; }
+    bool Succeeded() const { return m_Succeeded; }
+
+private:
+    std::string m_Filename;
+    MD_FileInfo m_Info;
+    bool m_Remembered = false;
+    bool m_Succeeded = false;
+};
+
+// Files smaller than this are read rather than mapped, setting up a mapping costs more
+// than copying a few pages
+const size_t MD_MIN_MAPPED_BYTES = 64 * 1024;
+
+// View of a whole file. Large files are memory mapped where the platform allows, anything
+// else is read into a buffer that's kept for the next Open. Either way Data() stays valid
+// until Close() or destruction.
+// Pages of a mapping that haven't been written still follow the file, so a file that's
+// rewritten in place changes under Data(), or faults when read if it shrank. Anything
+// that's kept open should be replaced by renaming a new file over it, as
+// md_write_file_atomic does, or read with a copy instead.
+class MD_MappedFile
+{
+public:
+    MD_MappedFile() = default;
+    ~MD_MappedFile();
+    MD_MappedFile(const MD_MappedFile&) = delete;
+    MD_MappedFile& operator=(const MD_MappedFile&) = delete;
+
+    bool Open(const char* filename);
+
+    // Open the file so MutableData() can be changed without touching the file, with a zero
+    // byte at Data()[Size()]. Mappings are copy-on-write. Suits parsers that work in place.
+    bool OpenCopyOnWrite(const char* filename);
+
+    // Read the file into the kept buffer and never map it, otherwise the same as
+    // OpenCopyOnWrite. For text that's kept after the file might be rewritten.
+    bool Read(const char* filename);
+
+    void Close();
+
+    bool IsOpen() const { return m_Open; }
+    bool IsMapped() const { return m_Mapped; }
+    const uint8_t* Data() const { return m_Data; }
+    uint8_t* MutableData() const { return m_Writable ? m_Data : nullptr; }
+    size_t Size() const { return m_Size; }
+
+private:
+    static size_t GetPageSize();
+    bool OpenFile(const char* filename, bool copyOnWrite, bool allowMapping);
+
+    uint8_t* m_Data = nullptr;
+    size_t m_Size = 0;
+    bool m_Open = false;
+    bool m_Mapped = false;
+    bool m_Writable = false;
+    std::vector<uint8_t> m_Buffer;  // The file and a trailing zero, when it isn't mapped
+#ifdef _WIN32
+    void* m_File = nullptr;
+    void* m_Mapping = nullptr;
+#endif
+};
+
+// Read a file from the start a piece at a time into chunk, handing each piece to func until
+// it returns false. The reads are the same as MD_MappedFile's, with no stdio buffer in
+// between. False if the file can't be opened or a read fails.
+bool md_read_file_chunks(const char* filename, void* chunk, size_t chunkBytes, const std::function<bool(const void* data, size_t size)>& func);
+
+// 64-bit hash of a block of memory, the XXH64 algorithm
+uint64_t md_hash64(const void* data, size_t bytes, uint64_t seed = 0);
+
+// Write a whole file through a temporary, so a reader never sees it half written
+bool md_write_file_atomic(const char* filename, const void* data, size_t bytes);
+
+// Called with the new contents of a data file, zero terminated. The text is only valid
+// during the call.
+typedef std::function<void(const char* text, size_t size)> MD_DataChangedFunc;
+
+struct MD_DataSourceStats
+{
+    uint64_t checks = 0;            // Times a file's size and time were looked at
+    uint64_t reads = 0;             // Files read because their size or time changed
+    uint64_t same_contents = 0;     // Reads that hashed the same as before
+    uint64_t changes = 0;           // Reads that went to subscribers
+};
+
+// Keeps track of the data files an app reloads. Checking a file is a stat(). It's only
+// read when its size or time moves, and subscribers only hear about it when the contents
+// hash differently from last time, so a file rewritten with the same bytes costs one read.
+class MD_DataSources
+{
+public:
+    // func is called from Poll() whenever the file's contents change, including the first
+    // time it's read. Returns an id for Unsubscribe.
+    int Subscribe(const char* filename, MD_DataChangedFunc func);
+    void Unsubscribe(int id);
+
+    // Check every subscribed file. Returns how many changed.
+    int Poll();
+
+    // Check one file, false if it's not subscribed to or hasn't changed
+    bool Poll(const char* filename);
+
+    const MD_DataSourceStats& GetStats() const { return m_Stats; }
+
+private:
+    struct Subscriber
+    {
+        int id = 0;
+        MD_DataChangedFunc func;
+        bool notified = false;      // Has been given the current contents
+    };
+
+    struct Source
+    {
+        std::string filename;
+        MD_FileSource file;         // Remembered after a successful read, along with hash
+        uint64_t hash = 0;
+        std::vector<Subscriber> subscribers;
+    };
+
+    bool PollSource(Source& source);
+
+    std::vector<Source> m_Sources;
+    MD_MappedFile m_File;           // Kept so small files reuse its buffer
+    MD_DataSourceStats m_Stats;
+    int m_NextId = 1;
+};
@@ -0,0 +1,1400 @@
+#include "microdraw.h"
+#include "microdraw_convert.h"
+#include "microdraw_headless.h"
+#include "microdraw_profile.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+// Software implementation of the md_* API with no window or display device.
+// Blits follow SDL's rules for colour keys, colour mods and clipping so frames
+// come out the same as the SDL backend's canvas.
+
+enum class HeadlessFormat
+{
+    XRGB8888,
+    RGB565,
+    RGBA32      // Images with an alpha channel, which SDL blends when drawing
+};
+
+struct MD_Image
+{
+    int w = 0;
+    int h = 0;
+    int pitch = 0;
+    HeadlessFormat format = HeadlessFormat::XRGB8888;
+    std::vector<uint8_t> pixels;
+    bool has_key = false;
+    uint32_t key = 0;
+    uint8_t mod_r = 255;
+    uint8_t mod_g = 255;
+    uint8_t mod_b = 255;
+    MD_Rect clip = { 0, 0, 0, 0 };
+};
+
+struct HeadlessContext
+{
+    MD_Image* canvas = nullptr;
+    DirtyRectList dirty;
+    DrawCommandList batch;
+    bool batching = false;
+    std::vector<uint16_t> framebuffer; // Stands in for /dev/fb1 so presenting costs the same work
+    int frame_count = 0;
+    int max_frames = 0;
+    std::string dump_prefix;
+    bool exit_raised = false;
+};
+
+HeadlessContext headlessContext;
+
+struct Format8888
+{
+    typedef uint32_t Pixel;
+
+    static inline void Unpack(Pixel c, uint32_t& r, uint32_t& g, uint32_t& b)
+    {
+        r = (c >> 16) & 0xFF;
+        g = (c >> 8) & 0xFF;
+        b = c & 0xFF;
+    }
+
+    static inline Pixel Pack(uint32_t r, uint32_t g, uint32_t b)
+    {
+        return (r << 16) | (g << 8) | b;
+    }
+
+    static inline uint32_t Alpha(Pixel)
+    {
+        return 255;
+    }
+
+    static inline Pixel PackAlpha(uint32_t r, uint32_t g, uint32_t b, uint32_t)
+    {
+        return Pack(r, g, b);
+    }
+
+    static inline Pixel KeyBits(Pixel c)
+    {
+        return c & 0x00FFFFFF;
+    }
+
+    static const bool HasAlpha = false;
+};
+
+// SDL_PIXELFORMAT_RGBA32 is bytes in R, G, B, A order, so on a little endian machine
+struct FormatRGBA32
+{
+    typedef uint32_t Pixel;
+
+    static inline void Unpack(Pixel c, uint32_t& r, uint32_t& g, uint32_t& b)
+    {
+        r = c & 0xFF;
+        g = (c >> 8) & 0xFF;
+        b = (c >> 16) & 0xFF;
+    }
+
+    static inline Pixel Pack(uint32_t r, uint32_t g, uint32_t b)
+    {
+        return PackAlpha(r, g, b, 255);
+    }
+
+    static inline uint32_t Alpha(Pixel c)
+    {
+        return c >> 24;
+    }
+
+    static inline Pixel PackAlpha(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+    {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    // Colour keys ignore alpha, as in SDL
+    static inline Pixel KeyBits(Pixel c)
+    {
+        return c & 0x00FFFFFF;
+    }
+
+    static const bool HasAlpha = true;
+};
+
+struct Format565
+{
+    typedef uint16_t Pixel;
+
+    static inline void Unpack(Pixel c, uint32_t& r, uint32_t& g, uint32_t& b)
+    {
+        // Replicate the top bits into the bottom, as SDL does when expanding
+        r = (c >> 11) & 0x1F;
+        g = (c >> 5) & 0x3F;
+        b = c & 0x1F;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+    }
+
+    static inline Pixel Pack(uint32_t r, uint32_t g, uint32_t b)
+    {
+        return (Pixel)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+    }
+
+    static inline uint32_t Alpha(Pixel)
+    {
+        return 255;
+    }
+
+    static inline Pixel PackAlpha(uint32_t r, uint32_t g, uint32_t b, uint32_t)
+    {
+        return Pack(r, g, b);
+    }
+
+    static inline Pixel KeyBits(Pixel c)
+    {
+        return c;
+    }
+
+    static const bool HasAlpha = false;
+};
+
+// Call func with the format struct for format, for code templated on it
+template <typename Func>
+static void WithFormat(HeadlessFormat format, Func&& func)
+{
+    switch (format)
+    {
+    case HeadlessFormat::RGB565:
+        func(Format565());
+        break;
+    case HeadlessFormat::RGBA32:
+        func(FormatRGBA32());
+        break;
+    default:
+        func(Format8888());
+        break;
+    }
+}
+
+static int BytesPerPixel(HeadlessFormat format)
+{
+    return format == HeadlessFormat::RGB565 ? 2 : 4;
+}
+
+static uint32_t MapRGB(HeadlessFormat format, uint8_t r, uint8_t g, uint8_t b)
+{
+    uint32_t pixel = 0;
+    WithFormat(format, [&](auto fmt) { pixel = decltype(fmt)::Pack(r, g, b); });
+    return pixel;
+}
+
+static MD_Image* CreateImage(int w, int h, HeadlessFormat format)
+{
+    MD_Image* image = new MD_Image();
+    image->w = w;
+    image->h = h;
+    image->format = format;
+    image->pitch = ((w * BytesPerPixel(format)) + 3) & ~3;
+    image->pixels.resize((size_t)image->pitch * h);
+    image->clip = { 0, 0, w, h };
+    return image;
+}
+
+template <typename Fmt>
+static inline typename Fmt::Pixel* RowPtr(MD_Image& image, int y)
+{
+    return (typename Fmt::Pixel*)(image.pixels.data() + ((size_t)y * image.pitch));
+}
+
+template <typename Fmt>
+static inline const typename Fmt::Pixel* RowPtr(const MD_Image& image, int y)
+{
+    return (const typename Fmt::Pixel*)(image.pixels.data() + ((size_t)y * image.pitch));
+}
+
+template <typename Fmt>
+static void FillRect(MD_Image& image, const MD_Rect& rect, typename Fmt::Pixel colour)
+{
+    for (int y = rect.y; y < rect.y + rect.h; ++y)
+    {
+        typename Fmt::Pixel* row = RowPtr<Fmt>(image, y);
+        std::fill(row + rect.x, row + rect.x + rect.w, colour);
+    }
+}
+
+template <typename SrcFmt, typename DstFmt>
+static void ConvertPixels(const MD_Image& src, MD_Image& dst)
+{
+    for (int y = 0; y < src.h; ++y)
+    {
+        const typename SrcFmt::Pixel* srcRow = RowPtr<SrcFmt>(src, y);
+        typename DstFmt::Pixel* dstRow = RowPtr<DstFmt>(dst, y);
+        for (int x = 0; x < src.w; ++x)
+        {
+            uint32_t r, g, b;
+            SrcFmt::Unpack(srcRow[x], r, g, b);
+            dstRow[x] = DstFmt::PackAlpha(r, g, b, SrcFmt::Alpha(srcRow[x]));
+        }
+    }
+}
+
+// Converting to a format without alpha drops it rather than blending, as SDL_ConvertSurface does
+static MD_Image* ConvertImage(const MD_Image& src, HeadlessFormat format)
+{
+    MD_Image* dst = CreateImage(src.w, src.h, format);
+    WithFormat(src.format, [&](auto srcFmt)
+    {
+        WithFormat(format, [&](auto dstFmt) { ConvertPixels<decltype(srcFmt), decltype(dstFmt)>(src, *dst); });
+    });
+    return dst;
+}
+
+// image itself if it's already in format, otherwise a converted copy and image is deleted
+static MD_Image* ToFormat(MD_Image* image, HeadlessFormat format)
+{
+    if (image->format == format)
+    {
+        return image;
+    }
+    MD_Image* converted = ConvertImage(*image, format);
+    delete image;
+    return converted;
+}
+
+//
+// BMP loading. Covers what the asset pipeline produces: 1/4/8 bit palettised (including
+// RLE4/RLE8), 16/24/32 bit, and bitfield masks.
+//
+
+static uint32_t ReadLE32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadLE16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t ExtractChannel(uint32_t pixel, uint32_t mask)
+{
+    if (mask == 0)
+    {
+        return 0;
+    }
+
+    int shift = 0;
+    while (((mask >> shift) & 1) == 0)
+    {
+        ++shift;
+    }
+    int bits = 0;
+    while (((mask >> (shift + bits)) & 1) != 0)
+    {
+        ++bits;
+    }
+
+    const uint32_t value = (pixel & mask) >> shift;
+    if (bits >= 8)
+    {
+        return value >> (bits - 8);
+    }
+    // Scale up narrow channels to the full 0-255 range
+    return (value * 255) / ((1u << bits) - 1);
+}
+
+static void DecodeRLE(const uint8_t* data, size_t size, int bpp, int w, int h, std::vector<uint8_t>& indices)
+{
+    // RLE bitmaps are always stored bottom up
+    indices.assign((size_t)w * h, 0);
+    int x = 0;
+    int y = h - 1;
+    size_t pos = 0;
+    auto put = [&](uint8_t index)
+    {
+        if (x < w && y >= 0)
+        {
+            indices[(size_t)y * w + x] = index;
+        }
+        ++x;
+    };
+
+    while (pos + 1 < size && y >= 0)
+    {
+        const uint8_t count = data[pos++];
+        const uint8_t value = data[pos++];
+        if (count > 0)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                put(bpp == 8 ? value : (uint8_t)((i & 1) ? (value & 0x0F) : (value >> 4)));
+            }
+            continue;
+        }
+
+        if (value == 0)
+        {
+            // End of line
+            x = 0;
+            --y;
+        }
+        else if (value == 1)
+        {
+            // End of bitmap
+            break;
+        }
+        else if (value == 2)
+        {
+            // Delta
+            if (pos + 1 >= size)
+            {
+                break;
+            }
+            x += data[pos++];
+            y -= data[pos++];
+        }
+        else
+        {
+            // Absolute run, padded to a 16-bit boundary
+            const int runBytes = bpp == 8 ? value : (value + 1) / 2;
+            for (int i = 0; i < value && pos < size; ++i)
+            {
+                if (bpp == 8)
+                {
+                    put(data[pos + i]);
+                }
+                else
+                {
+                    const uint8_t packed = data[pos + (i / 2)];
+                    put((uint8_t)((i & 1) ? (packed & 0x0F) : (packed >> 4)));
+                }
+            }
+            pos += runBytes + (runBytes & 1);
+        }
+    }
+}
+
+static MD_Image* LoadBMP(const char* filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return nullptr;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < 26 || bytes[0] != 'B' || bytes[1] != 'M')
+    {
+        return nullptr;
+    }
+
+    const uint8_t* info = bytes.data() + 14;
+    const uint32_t dataOffset = ReadLE32(bytes.data() + 10);
+    const uint32_t infoSize = ReadLE32(info);
+
+    int w = 0;
+    int h = 0;
+    int bpp = 0;
+    uint32_t compression = 0;
+    uint32_t coloursUsed = 0;
+    int paletteEntrySize = 4;
+    if (infoSize == 12)
+    {
+        // OS/2 core header
+        w = ReadLE16(info + 4);
+        h = (int16_t)ReadLE16(info + 6);
+        bpp = ReadLE16(info + 10);
+        paletteEntrySize = 3;
+    }
+    else
+    {
+        if (bytes.size() < 14 + 40)
+        {
+            return nullptr;
+        }
+        w = (int32_t)ReadLE32(info + 4);
+        h = (int32_t)ReadLE32(info + 8);
+        bpp = ReadLE16(info + 14);
+        compression = ReadLE32(info + 16);
+        coloursUsed = ReadLE32(info + 32);
+    }
+
+    const bool topDown = h < 0;
+    h = std::abs(h);
+    if (w <= 0 || h <= 0 || dataOffset >= bytes.size())
+    {
+        return nullptr;
+    }
+
+    // Default masks, replaced when the file gives its own. Like SDL, the spare byte of a
+    // plain 32 bit pixel is taken as alpha.
+    uint32_t rMask = 0x00FF0000;
+    uint32_t gMask = 0x0000FF00;
+    uint32_t bMask = 0x000000FF;
+    uint32_t aMask = bpp == 32 ? 0xFF000000 : 0;
+    if (bpp == 16)
+    {
+        rMask = 0x7C00;
+        gMask = 0x03E0;
+        bMask = 0x001F;
+    }
+    const uint32_t BI_BITFIELDS = 3;
+    if (compression == BI_BITFIELDS)
+    {
+        const uint8_t* masks = info + 40;
+        rMask = ReadLE32(masks);
+        gMask = ReadLE32(masks + 4);
+        bMask = ReadLE32(masks + 8);
+        aMask = infoSize >= 56 ? ReadLE32(masks + 12) : 0;
+    }
+
+    std::vector<uint32_t> palette;
+    if (bpp <= 8)
+    {
+        const int numColours = coloursUsed ? (int)coloursUsed : (1 << bpp);
+        const uint8_t* entry = info + infoSize;
+        for (int i = 0; i < numColours && entry + 3 <= bytes.data() + bytes.size(); ++i)
+        {
+            palette.push_back(Format8888::Pack(entry[2], entry[1], entry[0]));
+            entry += paletteEntrySize;
+        }
+        palette.resize(256, 0);
+    }
+
+    const bool hasAlpha = aMask != 0 && bpp > 8;
+    MD_Image* image = CreateImage(w, h, hasAlpha ? HeadlessFormat::RGBA32 : HeadlessFormat::XRGB8888);
+    const uint8_t* data = bytes.data() + dataOffset;
+    const size_t dataSize = bytes.size() - dataOffset;
+
+    const uint32_t BI_RLE8 = 1;
+    const uint32_t BI_RLE4 = 2;
+    if (compression == BI_RLE8 || compression == BI_RLE4)
+    {
+        std::vector<uint8_t> indices;
+        DecodeRLE(data, dataSize, compression == BI_RLE8 ? 8 : 4, w, h, indices);
+        for (int y = 0; y < h; ++y)
+        {
+            uint32_t* row = RowPtr<Format8888>(*image, y);
+            for (int x = 0; x < w; ++x)
+            {
+                row[x] = palette[indices[(size_t)y * w + x]];
+            }
+        }
+        return image;
+    }
+
+    const size_t stride = (((size_t)w * bpp + 31) / 32) * 4;
+    if (stride * h > dataSize)
+    {
+        delete image;
+        return nullptr;
+    }
+
+    for (int y = 0; y < h; ++y)
+    {
+        const uint8_t* src = data + (stride * (topDown ? y : (h - 1 - y)));
+        uint32_t* row = RowPtr<Format8888>(*image, y);
+        for (int x = 0; x < w; ++x)
+        {
+            switch (bpp)
+            {
+            case 1:
+                row[x] = palette[(src[x / 8] >> (7 - (x % 8))) & 1];
+                break;
+            case 4:
+                row[x] = palette[(src[x / 2] >> ((x & 1) ? 0 : 4)) & 0x0F];
+                break;
+            case 8:
+                row[x] = palette[src[x]];
+                break;
+            case 16:
+            case 32:
+            {
+                const uint32_t pixel = bpp == 16 ? ReadLE16(src + (x * 2)) : ReadLE32(src + (x * 4));
+                const uint32_t r = ExtractChannel(pixel, rMask);
+                const uint32_t g = ExtractChannel(pixel, gMask);
+                const uint32_t b = ExtractChannel(pixel, bMask);
+                row[x] = hasAlpha ? FormatRGBA32::PackAlpha(r, g, b, ExtractChannel(pixel, aMask)) : Format8888::Pack(r, g, b);
+                break;
+            }
+            case 24:
+                row[x] = Format8888::Pack(src[x * 3 + 2], src[x * 3 + 1], src[x * 3]);
+                break;
+            default:
+                delete image;
+                return nullptr;
+            }
+        }
+    }
+
+    // Also like SDL, alpha that's zero everywhere was never meant as alpha
+    if (hasAlpha)
+    {
+        bool allClear = true;
+        for (int y = 0; y < h && allClear; ++y)
+        {
+            const uint32_t* row = RowPtr<FormatRGBA32>(*image, y);
+            allClear = std::all_of(row, row + w, [](uint32_t c) { return FormatRGBA32::Alpha(c) == 0; });
+        }
+        for (int y = 0; y < h && allClear; ++y)
+        {
+            uint32_t* row = RowPtr<FormatRGBA32>(*image, y);
+            std::transform(row, row + w, row, [](uint32_t c) { return c | 0xFF000000; });
+        }
+    }
+    return image;
+}
+
+//
+// Frame output
+//
+
+static bool SavePPM(const MD_Image& image, const char* filename)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file << "P6\n" << image.w << " " << image.h << "\n255\n";
+    std::vector<uint8_t> row(image.w * 3);
+    for (int y = 0; y < image.h; ++y)
+    {
+        for (int x = 0; x < image.w; ++x)
+        {
+            uint32_t r, g, b;
+            if (image.format == HeadlessFormat::RGB565)
+            {
+                Format565::Unpack(RowPtr<Format565>(image, y)[x], r, g, b);
+            }
+            else
+            {
+                Format8888::Unpack(RowPtr<Format8888>(image, y)[x], r, g, b);
+            }
+            row[x * 3] = (uint8_t)r;
+            row[x * 3 + 1] = (uint8_t)g;
+            row[x * 3 + 2] = (uint8_t)b;
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return file.good();
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    static bool tableBuilt = false;
+    if (!tableBuilt)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        tableBuilt = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void AppendBE32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+static void WritePNGChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> chunk;
+    AppendBE32(chunk, (uint32_t)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    AppendBE32(chunk, Crc32(chunk.data() + 4, chunk.size() - 4));
+    file.write((const char*)chunk.data(), chunk.size());
+}
+
+// Uncompressed (stored deflate blocks) PNG. Bigger files, but no zlib dependency.
+static bool SavePNG(const MD_Image& image, const char* filename)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)(image.w * 3 + 1) * image.h);
+    for (int y = 0; y < image.h; ++y)
+    {
+        raw.push_back(0); // No filter
+        for (int x = 0; x < image.w; ++x)
+        {
+            uint32_t r, g, b;
+            if (image.format == HeadlessFormat::RGB565)
+            {
+                Format565::Unpack(RowPtr<Format565>(image, y)[x], r, g, b);
+            }
+            else
+            {
+                Format8888::Unpack(RowPtr<Format8888>(image, y)[x], r, g, b);
+            }
+            raw.push_back((uint8_t)r);
+            raw.push_back((uint8_t)g);
+            raw.push_back((uint8_t)b);
+        }
+    }
+
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    const size_t maxBlock = 65535;
+    for (size_t pos = 0; pos < raw.size() || pos == 0; pos += maxBlock)
+    {
+        const size_t len = std::min(maxBlock, raw.size() - pos);
+        const bool last = pos + len >= raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((uint8_t)len);
+        zlib.push_back((uint8_t)(len >> 8));
+        zlib.push_back((uint8_t)~len);
+        zlib.push_back((uint8_t)(~len >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+        if (last)
+        {
+            break;
+        }
+    }
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    AppendBE32(zlib, (b << 16) | a);
+
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write((const char*)signature, sizeof(signature));
+
+    std::vector<uint8_t> header;
+    AppendBE32(header, image.w);
+    AppendBE32(header, image.h);
+    header.push_back(8);  // Bit depth
+    header.push_back(2);  // Truecolour RGB
+    header.push_back(0);  // Compression
+    header.push_back(0);  // Filter
+    header.push_back(0);  // Interlace
+    WritePNGChunk(file, "IHDR", header);
+    WritePNGChunk(file, "IDAT", zlib);
+    WritePNGChunk(file, "IEND", {});
+    return file.good();
+}
+
+bool md_save_frame(const char* filename)
+{
+    if (!headlessContext.canvas || !filename)
+    {
+        return false;
+    }
+
+    const size_t len = strlen(filename);
+    if (len > 4 && (strcmp(filename + len - 4, ".png") == 0 || strcmp(filename + len - 4, ".PNG") == 0))
+    {
+        return SavePNG(*headlessContext.canvas, filename);
+    }
+    return SavePPM(*headlessContext.canvas, filename);
+}
+
+void md_headless_set_max_frames(int frames)
+{
+    headlessContext.max_frames = std::max(0, frames);
+}
+
+void md_headless_set_dump_prefix(const char* prefix)
+{
+    headlessContext.dump_prefix = prefix ? prefix : "";
+}
+
+int md_headless_get_frame_count()
+{
+    return headlessContext.frame_count;
+}
+
+//
+// md_* API
+//
+
+bool md_init(int width, int height)
+{
+    return md_init(width, height, MD_InitOptions());
+}
+
+bool md_init(int width, int height, const MD_InitOptions& options)
+{
+    const HeadlessFormat format = options.rgb565_canvas ? HeadlessFormat::RGB565 : HeadlessFormat::XRGB8888;
+    headlessContext.canvas = CreateImage(width, height, format);
+    headlessContext.framebuffer.assign((size_t)width * height, 0);
+    headlessContext.frame_count = 0;
+    headlessContext.exit_raised = false;
+    headlessContext.batching = options.batch_draws;
+
+    if (const char* frames = getenv("MD_HEADLESS_FRAMES"))
+    {
+        md_headless_set_max_frames(atoi(frames));
+    }
+    if (const char* prefix = getenv("MD_HEADLESS_DUMP"))
+    {
+        md_headless_set_dump_prefix(prefix);
+    }
+
+    md_mark_all_dirty();
+    return true;
+}
+
+void md_deinit()
+{
+    md_clear_text_cache();
+    delete headlessContext.canvas;
+    headlessContext.canvas = nullptr;
+    headlessContext.framebuffer.clear();
+}
+
+void mark_canvas_dirty(const MD_Rect& rect)
+{
+    MD_Rect touched;
+    if (md_intersect_rect(rect, headlessContext.canvas->clip, touched))
+    {
+        headlessContext.dirty.Add(touched);
+    }
+}
+
+void md_mark_dirty(const MD_Rect& rect)
+{
+    MD_Rect touched;
+    const MD_Rect bounds = { 0, 0, headlessContext.canvas->w, headlessContext.canvas->h };
+    if (md_intersect_rect(rect, bounds, touched))
+    {
+        headlessContext.dirty.Add(touched);
+    }
+}
+
+void md_mark_all_dirty()
+{
+    headlessContext.dirty.Clear();
+    headlessContext.dirty.Add(MD_Rect{ 0, 0, headlessContext.canvas->w, headlessContext.canvas->h });
+}
+
+MD_Image* md_load_image(const char* filename)
+{
+    MD_Image* loaded = LoadBMP(filename);
+    if (!loaded)
+    {
+        return nullptr;
+    }
+
+    // Match the canvas format now so blits don't convert every frame. Images loaded before
+    // md_init, or with an alpha channel the canvas would drop, keep the format they were
+    // read in.
+    if (!headlessContext.canvas || loaded->format == HeadlessFormat::RGBA32)
+    {
+        return loaded;
+    }
+    return ToFormat(loaded, headlessContext.canvas->format);
+}
+
+MD_Image* md_load_image_with_key(const char* filename, uint8_t key_r, uint8_t key_g, uint8_t key_b)
+{
+    MD_Image* image = LoadBMP(filename);
+    if (!image)
+    {
+        return nullptr;
+    }
+
+    // Always the canvas format, so any alpha is dropped and the key decides what's drawn
+    if (headlessContext.canvas)
+    {
+        image = ToFormat(image, headlessContext.canvas->format);
+    }
+    image->has_key = true;
+    image->key = MapRGB(image->format, key_r, key_g, key_b);
+    return image;
+}
+
+MD_Image* md_load_image_from_565_data_with_key(const char* data, int width, int height, uint8_t key_r, uint8_t key_g, uint8_t key_b)
+{
+    MD_Image* image = md_load_image_from_565_data(data, width, height);
+    image->has_key = true;
+    image->key = MapRGB(image->format, key_r, key_g, key_b);
+    return image;
+}
+
+MD_Image* md_load_image_from_565_data(const char* data, int width, int height)
+{
+    MD_Image* image = CreateImage(width, height, HeadlessFormat::RGB565);
+    for (int y = 0; y < height; ++y)
+    {
+        memcpy(RowPtr<Format565>(*image, y), data + ((size_t)y * width * 2), width * 2);
+    }
+    return image;
+}
+
+// Starts out transparent, as SDL_CreateSurface zeroes it
+MD_Image* md_create_image(int w, int h)
+{
+    return CreateImage(w, h, HeadlessFormat::RGBA32);
+}
+
+MD_Image* md_create_image_with_key(int w, int h, uint8_t key_r, uint8_t key_g, uint8_t key_b)
+{
+    MD_Image* image = CreateImage(w, h, headlessContext.canvas->format);
+    image->has_key = true;
+    image->key = MapRGB(image->format, key_r, key_g, key_b);
+    if (image->format == HeadlessFormat::RGB565)
+    {
+        FillRect<Format565>(*image, image->clip, (uint16_t)image->key);
+    }
+    else
+    {
+        FillRect<Format8888>(*image, image->clip, image->key);
+    }
+    return image;
+}
+
+void md_draw_pixel_to_image(MD_Image& image, int x, int y, uint8_t r, uint8_t g, uint8_t b)
+{
+    // The image may be the source of a recorded draw
+    md_flush_draws();
+
+    if (x < 0 || y < 0 || x >= image.w || y >= image.h)
+    {
+        return;
+    }
+
+    WithFormat(image.format, [&](auto fmt) { RowPtr<decltype(fmt)>(image, y)[x] = decltype(fmt)::Pack(r, g, b); });
+}
+
+void md_destroy_image(MD_Image& image)
+{
+    md_flush_draws();
+    delete &image;
+}
+
+int md_get_image_width(const MD_Image& image)
+{
+    return image.w;
+}
+
+int md_get_image_height(const MD_Image& image)
+{
+    return image.h;
+}
+
+// SDL's blend of one channel, (s * a + d * (255 - a)) / 255 without the divide
+static inline uint32_t BlendChannel(uint32_t s, uint32_t d, uint32_t a)
+{
+    uint32_t x = (uint32_t)(((int)s - (int)d) * (int)a + (int)((d << 8) - d)) + 1;
+    x += x >> 8;
+    return (x >> 8) & 0xFF;
+}
+
+// Copy src pixels to dst, mapping each dst pixel back to a source pixel through the
+// supplied lookup tables. Handles colour keys, colour mods and blending sources with alpha.
+template <typename SrcFmt, typename DstFmt>
+static void BlitPixels(const MD_Image& src, MD_Image& dst, const MD_Rect& dstArea, const int* srcXs, const int* srcYs)
+{
+    const bool modulate = src.mod_r != 255 || src.mod_g != 255 || src.mod_b != 255;
+    const typename SrcFmt::Pixel key = SrcFmt::KeyBits((typename SrcFmt::Pixel)src.key);
+
+    for (int y = 0; y < dstArea.h; ++y)
+    {
+        const typename SrcFmt::Pixel* srcRow = RowPtr<SrcFmt>(src, srcYs[y]);
+        typename DstFmt::Pixel* dstRow = RowPtr<DstFmt>(dst, dstArea.y + y) + dstArea.x;
+        for (int x = 0; x < dstArea.w; ++x)
+        {
+            const typename SrcFmt::Pixel c = srcRow[srcXs[x]];
+            if (src.has_key && SrcFmt::KeyBits(c) == key)
+            {
+                continue;
+            }
+
+            uint32_t r, g, b;
+            SrcFmt::Unpack(c, r, g, b);
+            if (modulate)
+            {
+                r = (r * src.mod_r) / 255;
+                g = (g * src.mod_g) / 255;
+                b = (b * src.mod_b) / 255;
+            }
+            if constexpr (!SrcFmt::HasAlpha)
+            {
+                dstRow[x] = DstFmt::Pack(r, g, b);
+                continue;
+            }
+
+            const uint32_t a = SrcFmt::Alpha(c);
+            if (a == 255)
+            {
+                dstRow[x] = DstFmt::PackAlpha(r, g, b, 255);
+            }
+            else if (a != 0)
+            {
+                const typename DstFmt::Pixel d = dstRow[x];
+                uint32_t dr, dg, db;
+                DstFmt::Unpack(d, dr, dg, db);
+                dstRow[x] = DstFmt::PackAlpha(BlendChannel(r, dr, a), BlendChannel(g, dg, a), BlendChannel(b, db, a), BlendChannel(255, DstFmt::Alpha(d), a));
+            }
+        }
+    }
+}
+
+// Blit srcArea of src into dstArea of dst, scaling with nearest sampling when sizes differ.
+// Both rects are in unclipped coordinates.
+static void BlitImage(const MD_Image& src, const MD_Rect& srcArea, MD_Image& dst, const MD_Rect& dstArea)
+{
+    if (srcArea.w <= 0 || srcArea.h <= 0 || dstArea.w <= 0 || dstArea.h <= 0)
+    {
+        return;
+    }
+
+    MD_Rect clipped;
+    if (!md_intersect_rect(dstArea, dst.clip, clipped))
+    {
+        return;
+    }
+
+    // Work out which source pixel lands on each destination column and row
+    static std::vector<int> srcXs;
+    static std::vector<int> srcYs;
+    srcXs.resize(clipped.w);
+    srcYs.resize(clipped.h);
+    for (int x = 0; x < clipped.w; ++x)
+    {
+        const int offset = clipped.x + x - dstArea.x;
+        srcXs[x] = srcArea.x + (int)(((int64_t)offset * srcArea.w) / dstArea.w);
+    }
+    for (int y = 0; y < clipped.h; ++y)
+    {
+        const int offset = clipped.y + y - dstArea.y;
+        srcYs[y] = srcArea.y + (int)(((int64_t)offset * srcArea.h) / dstArea.h);
+    }
+
+    const bool plainCopy = !src.has_key && src.format == dst.format && src.format != HeadlessFormat::RGBA32 && src.mod_r == 255 && src.mod_g == 255 && src.mod_b == 255;
+    if (plainCopy && srcArea.w == dstArea.w)
+    {
+        // Same format, no key or mod and no horizontal scaling, so rows copy straight across
+        const int bpp = BytesPerPixel(src.format);
+        for (int y = 0; y < clipped.h; ++y)
+        {
+            const uint8_t* srcRow = src.pixels.data() + ((size_t)srcYs[y] * src.pitch) + ((size_t)srcXs[0] * bpp);
+            uint8_t* dstRow = dst.pixels.data() + ((size_t)(clipped.y + y) * dst.pitch) + ((size_t)clipped.x * bpp);
+            memmove(dstRow, srcRow, (size_t)clipped.w * bpp);
+        }
+        return;
+    }
+
+    WithFormat(src.format, [&](auto srcFmt)
+    {
+        WithFormat(dst.format, [&](auto dstFmt)
+        {
+            BlitPixels<decltype(srcFmt), decltype(dstFmt)>(src, dst, clipped, srcXs.data(), srcYs.data());
+        });
+    });
+}
+
+// Start a batched command for drawing image into the canvas, capturing its current state
+static MD_DrawCommand MakeImageCommand(MD_Image& image, uint8_t type)
+{
+    MD_DrawCommand command;
+    command.image = &image;
+    command.type = type;
+    command.clip = headlessContext.canvas->clip;
+    command.r = image.mod_r;
+    command.g = image.mod_g;
+    command.b = image.mod_b;
+    command.opaque = !image.has_key && image.format != HeadlessFormat::RGBA32;
+    return command;
+}
+
+bool md_draw_image(MD_Image& image, MD_Rect* srcRect, MD_Image* dest, MD_Rect* destRect)
+{
+    MD_PROFILE_SCOPE(MD_STAT_DRAW_IMAGE, srcRect ? srcRect->w * srcRect->h : image.w * image.h);
+    MD_Image& target = dest ? *dest : *headlessContext.canvas;
+
+    // Like SDL, unscaled blits take their size from the source after clipping it to the image
+    MD_Rect area = srcRect ? *srcRect : MD_Rect{ 0, 0, image.w, image.h };
+    MD_Rect position = { destRect ? destRect->x : 0, destRect ? destRect->y : 0, 0, 0 };
+    MD_Rect srcClipped;
+    if (!md_intersect_rect(area, MD_Rect{ 0, 0, image.w, image.h }, srcClipped))
+    {
+        return true;
+    }
+    position.x += srcClipped.x - area.x;
+    position.y += srcClipped.y - area.y;
+    position.w = srcClipped.w;
+    position.h = srcClipped.h;
+
+    if (dest == nullptr)
+    {
+        mark_canvas_dirty(position);
+
+        if (headlessContext.batching)
+        {
+            MD_DrawCommand command = MakeImageCommand(image, MD_DrawCommand::IMAGE);
+            command.src = srcClipped;
+            command.dst = position;
+            if (md_clip_blit(image.w, image.h, command.clip, command.src, command.dst))
+            {
+                command.bounds = command.dst;
+                headlessContext.batch.Add(command);
+            }
+            return true;
+        }
+    }
+    else
+    {
+        // Drawing into an image that recorded draws may still read from
+        md_flush_draws();
+    }
+    BlitImage(image, srcClipped, target, position);
+    return true;
+}
+
+bool md_draw_image(MD_Image& image, int x, int y)
+{
+    MD_Rect destRect{ x, y, md_get_image_width(image), md_get_image_height(image) };
+    return md_draw_image(image, nullptr, nullptr, &destRect);
+}
+
+bool md_draw_image(MD_Image& image, MD_Rect& src, MD_Rect& dest)
+{
+    return md_draw_image(image, &src, nullptr, &dest);
+}
+
+bool md_draw_image(MD_Image& image)
+{
+    return md_draw_image(image, nullptr, nullptr, nullptr);
+}
+
+bool md_draw_image_scaled(MD_Image& image, MD_Rect* srcRect, MD_Image* dest, MD_Rect* destRect)
+{
+    MD_Image& target = dest ? *dest : *headlessContext.canvas;
+    const MD_Rect area = srcRect ? *srcRect : MD_Rect{ 0, 0, image.w, image.h };
+    MD_Rect position = destRect ? *destRect : MD_Rect{ 0, 0, target.w, target.h };
+    MD_PROFILE_SCOPE(MD_STAT_DRAW_IMAGE_SCALED, position.w * position.h);
+
+    // A source hanging off the image shrinks the destination, as in SDL
+    MD_Rect srcClipped = area;
+    if (!md_clip_scaled_source(image.w, image.h, srcClipped, position))
+    {
+        return true;
+    }
+
+    if (dest == nullptr)
+    {
+        mark_canvas_dirty(position);
+
+        if (headlessContext.batching)
+        {
+            MD_DrawCommand command = MakeImageCommand(image, MD_DrawCommand::IMAGE_SCALED);
+            command.src = srcClipped;
+            command.dst = position;
+            if (md_intersect_rect(position, command.clip, command.bounds))
+            {
+                headlessContext.batch.Add(command);
+            }
+            return true;
+        }
+    }
+    else
+    {
+        md_flush_draws();
+    }
+    BlitImage(image, srcClipped, target, position);
+    return true;
+}
+
+bool md_draw_image_scaled(MD_Image& image, MD_Rect& src, MD_Rect& dest)
+{
+    return md_draw_image_scaled(image, &src, nullptr, &dest);
+}
+
+bool md_draw_image_scaled(MD_Image& image, MD_Rect& dest)
+{
+    return md_draw_image_scaled(image, nullptr, nullptr, &dest);
+}
+
+static void FillCanvas(const MD_Rect& clipped, uint8_t r, uint8_t g, uint8_t b)
+{
+    MD_Image& canvas = *headlessContext.canvas;
+    if (canvas.format == HeadlessFormat::RGB565)
+    {
+        FillRect<Format565>(canvas, clipped, Format565::Pack(r, g, b));
+    }
+    else
+    {
+        FillRect<Format8888>(canvas, clipped, Format8888::Pack(r, g, b));
+    }
+}
+
+void md_filled_rect(MD_Rect& rect, uint8_t r, uint8_t g, uint8_t b)
+{
+    MD_PROFILE_SCOPE(MD_STAT_FILLED_RECT, rect.w * rect.h);
+    MD_Image& canvas = *headlessContext.canvas;
+    MD_Rect clipped;
+    if (!md_intersect_rect(rect, canvas.clip, clipped))
+    {
+        return;
+    }
+
+    mark_canvas_dirty(clipped);
+
+    if (headlessContext.batching)
+    {
+        MD_DrawCommand command;
+        command.type = MD_DrawCommand::FILL;
+        command.clip = canvas.clip;
+        command.dst = clipped;
+        command.bounds = clipped;
+        command.r = r;
+        command.g = g;
+        command.b = b;
+        command.opaque = true;
+        headlessContext.batch.Add(command);
+        return;
+    }
+    FillCanvas(clipped, r, g, b);
+}
+
+void md_set_image_clip(MD_Image& image, MD_Rect* rect)
+{
+    const MD_Rect bounds = { 0, 0, image.w, image.h };
+    if (!rect || !md_intersect_rect(*rect, bounds, image.clip))
+    {
+        image.clip = rect ? MD_Rect{ 0, 0, 0, 0 } : bounds;
+    }
+}
+
+void md_set_image_clip(MD_Image& image, MD_Rect& rect)
+{
+    md_set_image_clip(image, &rect);
+}
+
+void md_set_clip(MD_Rect& rect)
+{
+    md_set_image_clip(*headlessContext.canvas, &rect);
+}
+
+void md_clear_clip()
+{
+    md_set_image_clip(*headlessContext.canvas, nullptr);
+}
+
+void md_set_colour_mod(MD_Image& image, uint8_t key_r, uint8_t key_g, uint8_t key_b)
+{
+    image.mod_r = key_r;
+    image.mod_g = key_g;
+    image.mod_b = key_b;
+}
+
+void md_get_colour_mod(const MD_Image& image, uint8_t& r, uint8_t& g, uint8_t& b)
+{
+    r = image.mod_r;
+    g = image.mod_g;
+    b = image.mod_b;
+}
+
+void md_get_pixel_x_bounds(MD_Image& image, const MD_Rect& rect, int& xLeftOut, int& xRightOut)
+{
+    if (&image == headlessContext.canvas)
+    {
+        md_flush_draws();
+    }
+
+    const int startX = std::max(0, rect.x);
+    const int startY = std::max(0, rect.y);
+    const int endX = std::min(image.w, rect.x + rect.w);
+    const int endY = std::min(image.h, rect.y + rect.h);
+
+    auto isLit = [&](int x, int y)
+    {
+        if (image.format == HeadlessFormat::RGB565)
+        {
+            return RowPtr<Format565>(image, y)[x] != 0;
+        }
+        return (RowPtr<Format8888>(image, y)[x] & 0x00FFFFFF) != 0;
+    };
+
+    xLeftOut = rect.w;
+    xRightOut = 0;
+    for (int x = startX; x < endX; ++x)
+    {
+        for (int y = startY; y < endY; ++y)
+        {
+            if (isLit(x, y))
+            {
+                xLeftOut = std::min(xLeftOut, x - startX);
+                xRightOut = std::max(xRightOut, x - startX);
+                break;
+            }
+        }
+    }
+}
+
+// Convert the changed regions into the stand-in framebuffer, as blit_to_fb does for /dev/fb1
+void blit_to_fb(const MD_Image& canvas, const DirtyRectList& dirty)
+{
+    MD_PROFILE_SCOPE(MD_STAT_BLIT_TO_FB, dirty.GetPixelCount());
+    uint16_t* fb = headlessContext.framebuffer.data();
+    for (int i = 0; i < dirty.m_Count; ++i)
+    {
+        const MD_Rect& rect = dirty.m_Rects[i];
+        uint16_t* dst = fb + ((size_t)rect.y * canvas.w) + rect.x;
+        if (canvas.format == HeadlessFormat::RGB565)
+        {
+            for (int y = 0; y < rect.h; ++y)
+            {
+                memcpy(dst + ((size_t)y * canvas.w), RowPtr<Format565>(canvas, rect.y + y) + rect.x, (size_t)rect.w * 2);
+            }
+        }
+        else
+        {
+            md_convert_xrgb8888_to_rgb565(RowPtr<Format8888>(canvas, rect.y) + rect.x, canvas.pitch, dst, canvas.w * 2, rect.w, rect.h);
+        }
+    }
+}
+
+bool md_get_image_pixels(MD_Image& image, MD_PixelBuffer& out)
+{
+    if (image.format == HeadlessFormat::RGBA32)
+    {
+        return false;
+    }
+
+    out.pixels = image.pixels.data();
+    out.pitch = image.pitch;
+    out.w = image.w;
+    out.h = image.h;
+    out.rgb565 = image.format == HeadlessFormat::RGB565;
+    out.clip = image.clip;
+    return true;
+}
+
+static void RunGlyphCommand(const MD_DrawCommand& command)
+{
+    MD_PixelBuffer target;
+    md_get_image_pixels(*headlessContext.canvas, target);
+    target.clip = command.clip;
+    md_rasterise_glyph(target, *command.font, command.src, command.dst, command.r, command.g, command.b);
+}
+
+void md_draw_glyph(const Font& font, const MD_Rect& src, const MD_Rect& dst)
+{
+    MD_PROFILE_SCOPE(MD_STAT_DRAW_GLYPH, dst.w * dst.h);
+    mark_canvas_dirty(dst);
+
+    MD_DrawCommand command = MakeImageCommand(*font.m_Surface, MD_DrawCommand::GLYPH);
+    command.font = &font;
+    command.src = src;
+    command.dst = dst;
+    command.opaque = false;
+    if (headlessContext.batching)
+    {
+        if (md_intersect_rect(dst, command.clip, command.bounds))
+        {
+            headlessContext.batch.Add(command);
+        }
+        return;
+    }
+    RunGlyphCommand(command);
+}
+
+void md_flush_draws()
+{
+    DrawCommandList& batch = headlessContext.batch;
+    if (batch.IsEmpty())
+    {
+        return;
+    }
+
+    MD_PROFILE_SCOPE(MD_STAT_FLUSH_DRAWS, 0);
+    batch.Prepare();
+
+    MD_Image& canvas = *headlessContext.canvas;
+    const MD_Rect appClip = canvas.clip;
+    uint64_t pixels = 0;
+    for (const MD_DrawCommand& command : batch.m_Commands)
+    {
+        pixels += (uint64_t)command.bounds.w * command.bounds.h;
+        if (command.type == MD_DrawCommand::FILL)
+        {
+            FillCanvas(command.bounds, command.r, command.g, command.b);
+            continue;
+        }
+        if (command.type == MD_DrawCommand::GLYPH)
+        {
+            RunGlyphCommand(command);
+            continue;
+        }
+
+        // Run with the state the draw was recorded with
+        MD_Image& image = *command.image;
+        const uint8_t modR = image.mod_r;
+        const uint8_t modG = image.mod_g;
+        const uint8_t modB = image.mod_b;
+        image.mod_r = command.r;
+        image.mod_g = command.g;
+        image.mod_b = command.b;
+        canvas.clip = command.clip;
+        BlitImage(image, command.src, canvas, command.dst);
+        image.mod_r = modR;
+        image.mod_g = modG;
+        image.mod_b = modB;
+    }
+    MD_PROFILE_COUNT(MD_STAT_FLUSH_DRAWS, pixels);
+
+    canvas.clip = appClip;
+    batch.Clear();
+}
+
+void md_render()
+{
+    md_flush_draws();
+
+    HeadlessContext& ctx = headlessContext;
+    const bool idle = ctx.dirty.IsEmpty();
+    blit_to_fb(*ctx.canvas, ctx.dirty);
+    ctx.dirty.Clear();
+
+    if (!ctx.dump_prefix.empty())
+    {
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s_%05d.ppm", ctx.dump_prefix.c_str(), ctx.frame_count);
+        md_save_frame(filename);
+    }
+
+    ctx.frame_count++;
+    if (ctx.max_frames > 0 && ctx.frame_count >= ctx.max_frames)
+    {
+        ctx.exit_raised = true;
+    }
+
+    md_end_frame_stats();
+    md_pace_frame(idle);
+}
+
+bool md_exit_raised()
+{
+    return headlessContext.exit_raised;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Extra controls for the headless backend (microdraw_headless.cpp), which renders into an
+// in-memory canvas with no window or display device. Useful for benchmarks and for
+// capturing frames on build machines.
+//
+// The same settings can be given through the environment so apps run unmodified:
+//   MD_HEADLESS_FRAMES=<n>        raise md_exit_raised() after n frames
+//   MD_HEADLESS_DUMP=<prefix>     save every frame as <prefix>_00000.ppm etc.
+
+// Save the current canvas. The format comes from the extension, .png or .ppm
+bool md_save_frame(const char* filename);
+
+// Raise md_exit_raised() once this many frames have been rendered, 0 to never stop
+void md_headless_set_max_frames(int frames);
+
+// Save every rendered frame as <prefix>_<frame>.ppm, nullptr to stop
+void md_headless_set_dump_prefix(const char* prefix);
+
+// Frames rendered so far
+int md_headless_get_frame_count();
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "microdraw.h"
+
+// Per-frame profiling counters for the md_* API.
+// Define MD_PROFILING to enable them. Without it the scoped timers and the per-frame calls
+// compile to nothing, and md_get_frame_stats() always returns zeroed counters.
+
+enum MD_StatId
+{
+    MD_STAT_DRAW_IMAGE,
+    MD_STAT_DRAW_IMAGE_SCALED,
+    MD_STAT_FILLED_RECT,
+    MD_STAT_DRAW_GLYPH,
+    MD_STAT_FLUSH_DRAWS,    // Running batched draws, counts pixels written
+    MD_STAT_BLIT_TO_FB,
+    MD_STAT_UPDATE_TEXTURE,
+    MD_STAT_PARSE_JSON_FILE,
+    MD_STAT_LOAD_CONFIG,
+    MD_STAT_COUNT
+};
+
+struct MD_StatCounter
+{
+    uint32_t calls = 0;
+    uint64_t pixels = 0;    // Pixels touched, or bytes read for the file loading stats
+    uint64_t ns = 0;
+};
+
+struct MD_FrameStats
+{
+    uint64_t frame = 0;
+    MD_StatCounter counters[MD_STAT_COUNT];
+};
+
+const char* md_get_stat_name(MD_StatId id);
+
+#ifdef MD_PROFILING
+
+// Counters from the last completed frame
+MD_FrameStats md_get_frame_stats();
+
+// Draw the last frame's counters as text, one line per stat
+void md_draw_frame_stats(Font& font, int x, int y);
+
+// Called by the backend at the end of md_render() to close off the frame's counters
+void md_end_frame_stats();
+
+void md_add_stat(MD_StatId id, uint32_t calls, uint64_t pixels, uint64_t ns);
+
+class MD_ScopedStat
+{
+public:
+    MD_ScopedStat(MD_StatId id, uint64_t pixels)
+        : m_Id(id)
+        , m_Pixels(pixels)
+        , m_Start(md_time_ns())
+    {
+    }
+
+    ~MD_ScopedStat()
+    {
+        md_add_stat(m_Id, 1, m_Pixels, (uint64_t)(md_time_ns() - m_Start));
+    }
+
+    MD_StatId m_Id;
+    uint64_t m_Pixels;
+    int64_t m_Start;
+};
+
+#define MD_STAT_CONCAT_INNER(a, b) a##b
+#define MD_STAT_CONCAT(a, b) MD_STAT_CONCAT_INNER(a, b)
+#define MD_PROFILE_SCOPE(id, pixels) MD_ScopedStat MD_STAT_CONCAT(md_scoped_stat_, __LINE__)(id, pixels)
+
+// For work only known part way through a timed scope, like the size of a file
+#define MD_PROFILE_COUNT(id, pixels) md_add_stat(id, 0, pixels, 0)
+
+#else
+
+inline MD_FrameStats md_get_frame_stats() { return MD_FrameStats(); }
+inline void md_draw_frame_stats(Font& /*font*/, int /*x*/, int /*y*/) {}
+inline void md_end_frame_stats() {}
+
+#define MD_PROFILE_SCOPE(id, pixels) ((void)0)
+#define MD_PROFILE_COUNT(id, pixels) ((void)0)
+
+#endif
@@ -0,0 +1,309 @@
+#include "microdraw_scan.h"
+
+#include <cstring>
+
+#if defined(MD_SCAN_NO_SIMD)
+// Scalar only, for checking the vector paths against
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MD_SCAN_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// 32-bit NEON lacks the pairwise adds used to build bitmasks, so it takes the scalar path
+#define MD_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline int CountTrailingZeros(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#elif defined(_M_X64) || defined(_M_ARM64)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)bits))
+    {
+        return (int)index;
+    }
+    _BitScanForward(&index, (unsigned long)(bits >> 32));
+    return (int)index + 32;
+#endif
+}
+
+// Bit i is the parity of bits 0..i, so a run of ones starts at each opening quote and
+// stops before the closing one
+static inline uint64_t PrefixXor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+// One bit per byte of a 64 byte block for each class of character stage one cares about
+struct BlockMasks
+{
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t whitespace = 0;
+    uint64_t structural = 0;
+};
+
+#if !defined(MD_SCAN_SSE2) && !defined(MD_SCAN_NEON)
+static void ClassifyBlockScalar(const uint8_t* block, BlockMasks& masks)
+{
+    masks = BlockMasks();
+    for (int i = 0; i < 64; ++i)
+    {
+        const uint64_t bit = 1ull << i;
+        switch (block[i])
+        {
+        case '"':
+            masks.quote |= bit;
+            break;
+        case '\\':
+            masks.backslash |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            masks.whitespace |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            masks.structural |= bit;
+            break;
+        }
+    }
+}
+#endif
+
+#ifdef MD_SCAN_SSE2
+static inline uint64_t MoveMaskSSE2(__m128i bytes)
+{
+    return (uint64_t)(uint32_t)_mm_movemask_epi8(bytes);
+}
+
+static inline __m128i WhitespaceSSE2(__m128i v)
+{
+    return _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+}
+
+static void ClassifyBlockSSE2(const uint8_t* block, BlockMasks& masks)
+{
+    masks = BlockMasks();
+    for (int i = 0; i < 4; ++i)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(block + i * 16));
+
+        // Setting 0x20 folds [ and ] onto { and }
+        const __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i structural = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+
+        const int shift = i * 16;
+        masks.quote |= MoveMaskSSE2(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << shift;
+        masks.backslash |= MoveMaskSSE2(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << shift;
+        masks.whitespace |= MoveMaskSSE2(WhitespaceSSE2(v)) << shift;
+        masks.structural |= MoveMaskSSE2(structural) << shift;
+    }
+}
+#endif
+
+#ifdef MD_SCAN_NEON
+// Gather the top bit of each byte of four compare results into 64 bits
+static inline uint64_t MoveMask64NEON(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+    const uint8x16_t bits = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t sum0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+    uint8x16_t sum1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+static inline uint8x16_t WhitespaceNEON(uint8x16_t v)
+{
+    return vorrq_u8(
+        vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t'))),
+        vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r'))));
+}
+
+static void ClassifyBlockNEON(const uint8_t* block, BlockMasks& masks)
+{
+    uint8x16_t quote[4];
+    uint8x16_t backslash[4];
+    uint8x16_t whitespace[4];
+    uint8x16_t structural[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint8x16_t v = vld1q_u8(block + i * 16);
+        const uint8x16_t folded = vorrq_u8(v, vdupq_n_u8(0x20));
+        quote[i] = vceqq_u8(v, vdupq_n_u8('"'));
+        backslash[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+        whitespace[i] = WhitespaceNEON(v);
+        structural[i] = vorrq_u8(
+            vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')), vceqq_u8(v, vdupq_n_u8(','))));
+    }
+    masks.quote = MoveMask64NEON(quote[0], quote[1], quote[2], quote[3]);
+    masks.backslash = MoveMask64NEON(backslash[0], backslash[1], backslash[2], backslash[3]);
+    masks.whitespace = MoveMask64NEON(whitespace[0], whitespace[1], whitespace[2], whitespace[3]);
+    masks.structural = MoveMask64NEON(structural[0], structural[1], structural[2], structural[3]);
+}
+#endif
+
+static inline void ClassifyBlock(const uint8_t* block, BlockMasks& masks)
+{
+#if defined(MD_SCAN_SSE2)
+    ClassifyBlockSSE2(block, masks);
+#elif defined(MD_SCAN_NEON)
+    ClassifyBlockNEON(block, masks);
+#else
+    ClassifyBlockScalar(block, masks);
+#endif
+}
+
+bool md_json_index(const char* text, size_t length, std::vector<uint32_t>& indicesOut)
+{
+    indicesOut.clear();
+
+    // State carried from one block to the next
+    uint64_t escapedCarry = 0;      // Bit 0 set when the block starts with an escaped byte
+    uint64_t inStringCarry = 0;     // All ones when the block starts inside a string
+    uint64_t scalarCarry = 0;       // Bit 0 set when the last block ended partway through a value
+
+    for (size_t offset = 0; offset < length; offset += 64)
+    {
+        // The last partial block is padded with spaces, which never add an index
+        const uint8_t* block = (const uint8_t*)text + offset;
+        uint8_t tail[64];
+        if (length - offset < 64)
+        {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - offset);
+            block = tail;
+        }
+
+        BlockMasks masks;
+        ClassifyBlock(block, masks);
+
+        // A backslash escapes the byte after it unless it's escaped itself. Backslashes are
+        // rare enough to walk one at a time.
+        uint64_t escaped = escapedCarry;
+        escapedCarry = 0;
+        uint64_t backslashes = masks.backslash & ~escaped;
+        while (backslashes)
+        {
+            const int bit = CountTrailingZeros(backslashes);
+            if (bit == 63)
+            {
+                escapedCarry = 1;
+                break;
+            }
+            escaped |= 2ull << bit;
+            backslashes &= ~(3ull << bit);
+        }
+
+        const uint64_t quotes = masks.quote & ~escaped;
+        const uint64_t inString = PrefixXor(quotes) ^ inStringCarry;
+        inStringCarry = (uint64_t)((int64_t)inString >> 63);
+
+        // Anything that's not a quote, whitespace or structural and not in a string is
+        // part of a number or literal. Only the first byte of each run is wanted.
+        const uint64_t scalar = ~(masks.quote | masks.whitespace | masks.structural | inString);
+        const uint64_t scalarStarts = scalar & ~((scalar << 1) | scalarCarry);
+        scalarCarry = scalar >> 63;
+
+        uint64_t indices = (masks.structural & ~inString) | (quotes & inString) | scalarStarts;
+        while (indices)
+        {
+            indicesOut.push_back((uint32_t)(offset + CountTrailingZeros(indices)));
+            indices &= indices - 1;
+        }
+    }
+    return inStringCarry == 0;
+}
+
+const char* md_json_find_quote_or_backslash(const char* text, const char* end)
+{
+#if defined(MD_SCAN_SSE2)
+    for (; end - text >= 16; text += 16)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i*)text);
+        const int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+        if (mask)
+        {
+            return text + CountTrailingZeros((uint64_t)mask);
+        }
+    }
+#elif defined(MD_SCAN_NEON)
+    for (; end - text >= 16; text += 16)
+    {
+        const uint8x16_t v = vld1q_u8((const uint8_t*)text);
+        const uint8x16_t match = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+        if (vmaxvq_u8(match))
+        {
+            break;
+        }
+    }
+#endif
+    while (text < end && *text != '"' && *text != '\\')
+    {
+        text++;
+    }
+    return text;
+}
+
+const char* md_json_skip_whitespace(const char* text, const char* end)
+{
+    // Most gaps are a byte or two, so only reach for vectors once past those
+    for (int i = 0; i < 2; ++i, ++text)
+    {
+        if (text == end || (*text != ' ' && *text != '\t' && *text != '\n' && *text != '\r'))
+        {
+            return text;
+        }
+    }
+#if defined(MD_SCAN_SSE2)
+    for (; end - text >= 16; text += 16)
+    {
+        const int mask = ~_mm_movemask_epi8(WhitespaceSSE2(_mm_loadu_si128((const __m128i*)text))) & 0xFFFF;
+        if (mask)
+        {
+            return text + CountTrailingZeros((uint64_t)mask);
+        }
+    }
+#elif defined(MD_SCAN_NEON)
+    for (; end - text >= 16; text += 16)
+    {
+        if (vminvq_u8(WhitespaceNEON(vld1q_u8((const uint8_t*)text))) == 0)
+        {
+            break;
+        }
+    }
+#endif
+    while (text < end && (*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r'))
+    {
+        text++;
+    }
+    return text;
+}
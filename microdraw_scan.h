@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+// Byte scanning kernels for the JSON parsers. They look at 16 bytes at a time with SSE2
+// or NEON where available, and give the same results as the scalar fallback.
+
+// Stage one of JSONTape parsing, after simdjson: the offset of every structural character
+// ({ } [ ] : ,) outside of strings, every opening quote, and the first byte of every other
+// value, in order. Whitespace and string contents never appear. Returns false if the text
+// ends inside a string.
+bool md_json_index(const char* text, size_t length, std::vector<uint32_t>& indicesOut);
+
+// First '"' or '\\' in [text, end), or end
+const char* md_json_find_quote_or_backslash(const char* text, const char* end);
+
+// First byte in [text, end) that isn't JSON whitespace (space, tab, CR or LF), or end
+const char* md_json_skip_whitespace(const char* text, const char* end);
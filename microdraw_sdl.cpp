@@ -1,10 +1,16 @@
 #include "microdraw.h"
+#include "microdraw_convert.h"
+#include "microdraw_profile.h"
 
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #ifdef __linux__
 #include <fcntl.h>
@@ -16,6 +22,7 @@
 
 #include <SDL3/SDL.h>
 
+// Default pacing for the desktop preview, which has no framebuffer to wait on
 const int FB_FPS_LIMIT = 4;
 
 struct MicroDrawContext
@@ -24,89 +31,439 @@ struct MicroDrawContext
     SDL_Renderer* ren = nullptr;
     SDL_Surface* canvas = nullptr;
     SDL_Texture* screen_tex = nullptr;
+    DirtyRectList dirty;
+    DrawCommandList batch;
+    bool batching = false;
     bool exit_raised = false;
 };
 
 MicroDrawContext sdlContext;
 
+const int MD_MAX_PRESENT_SLOTS = 3;
+
+// One canvas in the present ring. The app draws into one slot while the present
+// thread pushes earlier finished slots out to the framebuffer.
+struct PresentSlot
+{
+    SDL_Surface* canvas = nullptr;
+    DirtyRectList dirty;    // What changed in the frame this slot was submitted with
+    DirtyRectList stale;    // What changed in other slots since this one was last drawn into
+    bool busy = false;      // Queued for, or being read by, the present thread
+};
+
+struct PresentThread
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    PresentSlot slots[MD_MAX_PRESENT_SLOTS];
+    std::deque<int> queue;
+    int num_slots = 0;
+    int drawing = 0;
+    bool quit = false;
+};
+
+PresentThread presentThread;
+
 typedef struct {
     int fb_fd;
     unsigned short* fbp;
-    int xres;
+    int xres;           // Row stride in pixels
+    int yres;
+    size_t map_size;
+    int num_buffers;    // 2 when the driver lets us pan between two screens, otherwise 1
+    int back_buffer;    // Index of the buffer not currently being scanned out
+    bool can_vsync;
+    DirtyRectList prev_dirty; // What changed in the frame before, which the back buffer also missed
+#ifdef __linux__
+    struct fb_var_screeninfo vinfo;
+#endif
 } FBInfo;
 
 
-FBInfo fb_info = { -1, NULL, 0 };
+FBInfo fb_info = { -1, NULL, 0, 0, 0, 1, 0, false };
 
-bool init_fb() {
+#ifdef __linux__
+// Ask for a virtual screen twice the visible height and check we can pan around it.
+// fbtft style SPI drivers have neither the memory nor pan support, so this fails there.
+bool init_fb_double_buffer(struct fb_var_screeninfo& vinfo, const struct fb_fix_screeninfo& finfo) {
+    if (vinfo.yres_virtual < vinfo.yres * 2) {
+        struct fb_var_screeninfo wanted = vinfo;
+        wanted.yres_virtual = vinfo.yres * 2;
+        if (ioctl(fb_info.fb_fd, FBIOPUT_VSCREENINFO, &wanted) == -1) return false;
+        if (ioctl(fb_info.fb_fd, FBIOGET_VSCREENINFO, &vinfo) == -1) return false;
+        if (vinfo.yres_virtual < vinfo.yres * 2) return false;
+    }
+
+    struct fb_fix_screeninfo newFinfo;
+    if (ioctl(fb_info.fb_fd, FBIOGET_FSCREENINFO, &newFinfo) == -1) return false;
+    if (newFinfo.smem_len < newFinfo.line_length * vinfo.yres * 2) return false;
+
+    vinfo.yoffset = 0;
+    if (ioctl(fb_info.fb_fd, FBIOPAN_DISPLAY, &vinfo) == -1) return false;
+    return true;
+}
+#endif
+
+bool init_fb(const MD_InitOptions& options) {
 #ifdef __linux__
     fb_info.fb_fd = open("/dev/fb1", O_RDWR);
     if (fb_info.fb_fd == -1) return false;
     struct fb_var_screeninfo vinfo;
     if (ioctl(fb_info.fb_fd, FBIOGET_VSCREENINFO, &vinfo) == -1) return false;
-    fb_info.xres = vinfo.xres;
-    fb_info.fbp = (unsigned short*)mmap(0, vinfo.xres * vinfo.yres * 2, PROT_READ | PROT_WRITE, MAP_SHARED, fb_info.fb_fd, 0);
+    struct fb_fix_screeninfo finfo;
+    if (ioctl(fb_info.fb_fd, FBIOGET_FSCREENINFO, &finfo) == -1) return false;
+
+    fb_info.num_buffers = 1;
+    if (options.double_buffer_fb && init_fb_double_buffer(vinfo, finfo)) {
+        fb_info.num_buffers = 2;
+        fb_info.back_buffer = 1;
+        ioctl(fb_info.fb_fd, FBIOGET_FSCREENINFO, &finfo);
+    }
+
+    // Some drivers pad their rows, so prefer the real line length over xres
+    fb_info.xres = finfo.line_length ? finfo.line_length / 2 : vinfo.xres;
+    fb_info.yres = vinfo.yres;
+    fb_info.vinfo = vinfo;
+    fb_info.map_size = (size_t)fb_info.xres * vinfo.yres * 2 * fb_info.num_buffers;
+    fb_info.fbp = (unsigned short*)mmap(0, fb_info.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fb_info.fb_fd, 0);
+    if (fb_info.fbp == MAP_FAILED) {
+        fb_info.fbp = NULL;
+        return false;
+    }
+
+    __u32 dummy = 0;
+    fb_info.can_vsync = fb_info.num_buffers > 1 && ioctl(fb_info.fb_fd, FBIO_WAITFORVSYNC, &dummy) != -1;
     return true;
 #endif
     return true;
 }
 
+// Show the buffer we just finished writing and swap to the other one
+void flip_fb() {
+#ifdef __linux__
+    if (fb_info.num_buffers < 2) return;
+
+    if (fb_info.can_vsync) {
+        __u32 dummy = 0;
+        ioctl(fb_info.fb_fd, FBIO_WAITFORVSYNC, &dummy);
+    }
+    fb_info.vinfo.yoffset = fb_info.back_buffer * fb_info.yres;
+    ioctl(fb_info.fb_fd, FBIOPAN_DISPLAY, &fb_info.vinfo);
+    fb_info.back_buffer = 1 - fb_info.back_buffer;
+#endif
+}
+
+void start_present_thread(int numSlots);
+void stop_present_thread();
+
 bool md_init(int width, int height)
+{
+    return md_init(width, height, MD_InitOptions());
+}
+
+bool md_init(int width, int height, const MD_InitOptions& options)
 {
     SDL_Init(SDL_INIT_VIDEO);
     sdlContext.win = SDL_CreateWindow("Pi Display", width, height, 0);
     sdlContext.ren = SDL_CreateRenderer(sdlContext.win, nullptr);
 
+    const SDL_PixelFormat format = options.rgb565_canvas ? SDL_PIXELFORMAT_RGB565 : SDL_PIXELFORMAT_XRGB8888;
 
     // 1. Create the Surface for drawing (CPU side)
-    sdlContext.canvas = SDL_CreateSurface(width, height, SDL_PIXELFORMAT_XRGB8888);
+    sdlContext.canvas = SDL_CreateSurface(width, height, format);
 
     // 2. Create ONE Texture (GPU side) - Do this BEFORE the loop
     sdlContext.screen_tex = SDL_CreateTexture(sdlContext.ren,
-        SDL_PIXELFORMAT_XRGB8888,
+        format,
         SDL_TEXTUREACCESS_STREAMING,
         width, height);
 
-    return init_fb();
+    // Nothing has been pushed to the display yet
+    md_mark_all_dirty();
+    sdlContext.batching = options.batch_draws;
+
+#ifndef __linux__
+    md_set_target_fps(FB_FPS_LIMIT);
+#endif
+
+    if (options.present_thread_slots > 0)
+    {
+        start_present_thread(options.present_thread_slots);
+    }
+
+    return init_fb(options);
 }
 
 void md_deinit()
 {
+    stop_present_thread();
+    md_clear_text_cache();
+
     // TODO - leaks
     // clear context
     SDL_Quit();
 }
 
 
-void blit_to_fb(SDL_Surface* surf) {
+void blit_to_fb(SDL_Surface* surf, const DirtyRectList& dirty) {
 #ifdef __linux__
     if (!fb_info.fbp) return;
-    Uint32* p = (Uint32*)surf->pixels;
-    for (int y = 0; y < surf->h; y++) {
-        for (int x = 0; x < surf->w; x++) {
-            Uint32 c = p[y * surf->w + x];
-            fb_info.fbp[y * fb_info.xres + x] = ((c >> 19) << 11) | (((c >> 10) & 0x3F) << 5) | (c >> 3 & 0x1F);
+
+    // The back buffer was last written two frames ago, so it also needs whatever changed last frame
+    DirtyRectList regions = dirty;
+    unsigned short* buffer = fb_info.fbp;
+    if (fb_info.num_buffers > 1) {
+        for (int i = 0; i < fb_info.prev_dirty.m_Count; ++i) {
+            regions.Add(fb_info.prev_dirty.m_Rects[i]);
+        }
+        fb_info.prev_dirty = dirty;
+        buffer += fb_info.back_buffer * fb_info.yres * fb_info.xres;
+    }
+
+    MD_PROFILE_SCOPE(MD_STAT_BLIT_TO_FB, regions.GetPixelCount());
+    const bool native565 = surf->format == SDL_PIXELFORMAT_RGB565;
+    for (int i = 0; i < regions.m_Count; ++i) {
+        const MD_Rect& rect = regions.m_Rects[i];
+        unsigned short* dst = buffer + (rect.y * fb_info.xres) + rect.x;
+        if (native565) {
+            // Already in the framebuffer's format, so each row is a plain copy
+            const Uint8* src = (const Uint8*)surf->pixels + (rect.y * surf->pitch) + (rect.x * 2);
+            for (int y = 0; y < rect.h; y++) {
+                memcpy(dst + (y * fb_info.xres), src + (y * surf->pitch), rect.w * 2);
+            }
+        }
+        else {
+            const Uint8* src = (const Uint8*)surf->pixels + (rect.y * surf->pitch) + (rect.x * 4);
+            md_convert_xrgb8888_to_rgb565(src, surf->pitch, dst, fb_info.xres * 2, rect.w, rect.h);
         }
     }
-#else
-    SDL_Delay(1000 / FB_FPS_LIMIT);
+
+    flip_fb();
 #endif
 }
 
 
 
+// Record the part of the canvas a draw call is about to touch, after clipping
+void mark_canvas_dirty(const MD_Rect& rect)
+{
+    SDL_Rect clip;
+    SDL_GetSurfaceClipRect(sdlContext.canvas, &clip);
+
+    MD_Rect touched;
+    if (md_intersect_rect(rect, *(MD_Rect*)&clip, touched))
+    {
+        sdlContext.dirty.Add(touched);
+    }
+}
+
+void md_mark_dirty(const MD_Rect& rect)
+{
+    MD_Rect touched;
+    const MD_Rect bounds = { 0, 0, sdlContext.canvas->w, sdlContext.canvas->h };
+    if (md_intersect_rect(rect, bounds, touched))
+    {
+        sdlContext.dirty.Add(touched);
+    }
+}
+
+void md_mark_all_dirty()
+{
+    sdlContext.dirty.Clear();
+    sdlContext.dirty.Add(MD_Rect{ 0, 0, sdlContext.canvas->w, sdlContext.canvas->h });
+}
+
+static MD_Rect get_canvas_clip()
+{
+    SDL_Rect clip;
+    SDL_GetSurfaceClipRect(sdlContext.canvas, &clip);
+    return *(MD_Rect*)&clip;
+}
+
+// Start a batched command for drawing surface into the canvas, capturing its current state
+static MD_DrawCommand make_image_command(SDL_Surface* surface, uint8_t type)
+{
+    MD_DrawCommand command;
+    command.image = (MD_Image*)surface;
+    command.type = type;
+    command.clip = get_canvas_clip();
+    SDL_GetSurfaceColorMod(surface, &command.r, &command.g, &command.b);
+
+    SDL_BlendMode blend = SDL_BLENDMODE_NONE;
+    SDL_GetSurfaceBlendMode(surface, &blend);
+    command.opaque = !SDL_SurfaceHasColorKey(surface) && blend == SDL_BLENDMODE_NONE;
+    return command;
+}
+
+bool md_get_image_pixels(MD_Image& image, MD_PixelBuffer& out)
+{
+    // Images are plain software surfaces with no RLE, so there's nothing to lock
+    SDL_Surface* surface = (SDL_Surface*)&image;
+    if (surface->format != SDL_PIXELFORMAT_XRGB8888 && surface->format != SDL_PIXELFORMAT_RGB565)
+    {
+        return false;
+    }
+
+    out.pixels = (uint8_t*)surface->pixels;
+    out.pitch = surface->pitch;
+    out.w = surface->w;
+    out.h = surface->h;
+    out.rgb565 = surface->format == SDL_PIXELFORMAT_RGB565;
+    SDL_GetSurfaceClipRect(surface, (SDL_Rect*)&out.clip);
+    return true;
+}
+
+static void run_glyph_command(const MD_DrawCommand& command)
+{
+    MD_PixelBuffer target;
+    if (md_get_image_pixels(*(MD_Image*)sdlContext.canvas, target))
+    {
+        target.clip = command.clip;
+        md_rasterise_glyph(target, *command.font, command.src, command.dst, command.r, command.g, command.b);
+    }
+}
+
+void md_draw_glyph(const Font& font, const MD_Rect& src, const MD_Rect& dst)
+{
+    MD_PROFILE_SCOPE(MD_STAT_DRAW_GLYPH, dst.w * dst.h);
+    mark_canvas_dirty(dst);
+
+    MD_DrawCommand command = make_image_command((SDL_Surface*)font.m_Surface, MD_DrawCommand::GLYPH);
+    command.font = &font;
+    command.src = src;
+    command.dst = dst;
+    command.opaque = false;
+    if (sdlContext.batching)
+    {
+        if (md_intersect_rect(dst, command.clip, command.bounds))
+        {
+            sdlContext.batch.Add(command);
+        }
+        return;
+    }
+    run_glyph_command(command);
+}
+
+void md_flush_draws()
+{
+    DrawCommandList& batch = sdlContext.batch;
+    if (batch.IsEmpty())
+    {
+        return;
+    }
+
+    MD_PROFILE_SCOPE(MD_STAT_FLUSH_DRAWS, 0);
+    batch.Prepare();
+
+    SDL_Surface* canvas = sdlContext.canvas;
+    const MD_Rect appClip = get_canvas_clip();
+    MD_Rect currentClip = appClip;
+
+    // Colour mods changed while running the batch, put back afterwards
+    struct SavedMod
+    {
+        SDL_Surface* surface;
+        Uint8 r, g, b;
+    };
+    std::vector<SavedMod> savedMods;
+
+    SDL_Surface* lastSurface = nullptr;
+    Uint8 lastR = 0, lastG = 0, lastB = 0;
+    uint64_t pixels = 0;
+    for (const MD_DrawCommand& command : batch.m_Commands)
+    {
+        pixels += (uint64_t)command.bounds.w * command.bounds.h;
+
+        // Fills and scaled blits clip against the canvas, so give them the clip they were recorded with
+        if ((command.type == MD_DrawCommand::FILL || command.type == MD_DrawCommand::IMAGE_SCALED) && memcmp(&currentClip, &command.clip, sizeof(MD_Rect)) != 0)
+        {
+            currentClip = command.clip;
+            SDL_SetSurfaceClipRect(canvas, (const SDL_Rect*)&currentClip);
+        }
+
+        if (command.type == MD_DrawCommand::FILL)
+        {
+            SDL_FillSurfaceRect(canvas, (const SDL_Rect*)&command.bounds, SDL_MapSurfaceRGB(canvas, command.r, command.g, command.b));
+            continue;
+        }
+        if (command.type == MD_DrawCommand::GLYPH)
+        {
+            run_glyph_command(command);
+            continue;
+        }
+
+        // Commands are grouped by image and mod, so this rarely has to change anything
+        SDL_Surface* surface = (SDL_Surface*)command.image;
+        if (surface != lastSurface)
+        {
+            SDL_GetSurfaceColorMod(surface, &lastR, &lastG, &lastB);
+            lastSurface = surface;
+        }
+        if (lastR != command.r || lastG != command.g || lastB != command.b)
+        {
+            const bool saved = std::any_of(savedMods.begin(), savedMods.end(), [&](const SavedMod& mod) { return mod.surface == surface; });
+            if (!saved)
+            {
+                savedMods.push_back({ surface, lastR, lastG, lastB });
+            }
+            SDL_SetSurfaceColorMod(surface, command.r, command.g, command.b);
+            lastR = command.r;
+            lastG = command.g;
+            lastB = command.b;
+        }
+
+        if (command.type == MD_DrawCommand::IMAGE)
+        {
+            // Clipped when recorded, so skip SDL_BlitSurface's checks
+            SDL_Rect src = *(const SDL_Rect*)&command.src;
+            SDL_Rect dst = *(const SDL_Rect*)&command.dst;
+            SDL_BlitSurfaceUnchecked(surface, &src, canvas, &dst);
+        }
+        else
+        {
+            SDL_BlitSurfaceScaled(surface, (const SDL_Rect*)&command.src, canvas, (SDL_Rect*)&command.dst, SDL_SCALEMODE_NEAREST);
+        }
+    }
+    MD_PROFILE_COUNT(MD_STAT_FLUSH_DRAWS, pixels);
+
+    for (const SavedMod& mod : savedMods)
+    {
+        SDL_SetSurfaceColorMod(mod.surface, mod.r, mod.g, mod.b);
+    }
+    SDL_SetSurfaceClipRect(canvas, (const SDL_Rect*)&appClip);
+    batch.Clear();
+}
+
 MD_Image* md_load_image(const char* filename)
 {
     SDL_Surface* image = SDL_LoadBMP(filename);
-    return (MD_Image*)image;
+    if (!image)
+    {
+        return nullptr;
+    }
+
+    // Match the canvas format now so blits don't convert every frame. Images loaded before
+    // md_init, or with an alpha channel the canvas would drop, are kept as they are.
+    if (!sdlContext.canvas || image->format == sdlContext.canvas->format || SDL_ISPIXELFORMAT_ALPHA(image->format))
+    {
+        return (MD_Image*)image;
+    }
+    SDL_Surface* surface = SDL_ConvertSurface(image, sdlContext.canvas->format);
+    SDL_DestroySurface(image);
+    return (MD_Image*)surface;
 }
 
 MD_Image* md_load_image_with_key(const char* filename, uint8_t key_r, uint8_t key_g, uint8_t key_b)
 {
     SDL_Surface* temp_font = SDL_LoadBMP(filename);
+    if (!temp_font)
+    {
+        return nullptr;
+    }
     SDL_PixelFormat format = sdlContext.canvas->format;
 
-    // Force the font into the EXACT same format as our canvas (32-bit ARGB/XRGB)
+    // Force the font into the EXACT same format as our canvas (XRGB8888 or RGB565)
     SDL_Surface* surface = SDL_ConvertSurface(temp_font, format);
     SDL_DestroySurface(temp_font);
 
@@ -136,8 +493,19 @@ MD_Image* md_create_image(int w, int h)
     return (MD_Image*)new_surface;
 }
 
+MD_Image* md_create_image_with_key(int w, int h, uint8_t key_r, uint8_t key_g, uint8_t key_b)
+{
+    SDL_Surface* new_surface = SDL_CreateSurface(w, h, sdlContext.canvas->format);
+    const Uint32 key = SDL_MapSurfaceRGB(new_surface, key_r, key_g, key_b);
+    SDL_FillSurfaceRect(new_surface, nullptr, key);
+    SDL_SetSurfaceColorKey(new_surface, true, key);
+    return (MD_Image*)new_surface;
+}
+
 void md_draw_pixel_to_image(MD_Image& image, int x, int y, uint8_t r, uint8_t g, uint8_t b)
 {
+    // The image may be the source of a recorded draw
+    md_flush_draws();
     SDL_Surface* surface = (SDL_Surface*)&image;
     Uint32* pixels = (Uint32*)surface->pixels;
     const int pixelIdx = (y * surface->w) + x;
@@ -146,6 +514,7 @@ void md_draw_pixel_to_image(MD_Image& image, int x, int y, uint8_t r, uint8_t g,
 
 void md_destroy_image(MD_Image& image)
 {
+    md_flush_draws();
     SDL_Surface* sdl_surface = (SDL_Surface*)&image;
     SDL_DestroySurface(sdl_surface);
 }
@@ -165,9 +534,44 @@ int md_get_image_height(const MD_Image& image)
 bool md_draw_image(MD_Image& image, MD_Rect* srcRect, MD_Image* dest, MD_Rect* destRect)
 {
     SDL_Surface* sdl_src = (SDL_Surface*)&image;
+    MD_PROFILE_SCOPE(MD_STAT_DRAW_IMAGE, srcRect ? srcRect->w * srcRect->h : sdl_src->w * sdl_src->h);
     SDL_Rect* sdl_srcRect = (SDL_Rect*)srcRect;
     SDL_Surface* sdl_dest = dest == nullptr ? sdlContext.canvas : (SDL_Surface*)dest;
     SDL_Rect* sdl_destRect = (SDL_Rect*)destRect;
+    if (dest == nullptr)
+    {
+        // Unscaled blits only take the position from the dest rect, the size comes from the source
+        MD_Rect touched = { 0, 0, sdl_src->w, sdl_src->h };
+        if (srcRect)
+        {
+            touched.w = srcRect->w;
+            touched.h = srcRect->h;
+        }
+        if (destRect)
+        {
+            touched.x = destRect->x;
+            touched.y = destRect->y;
+        }
+        mark_canvas_dirty(touched);
+
+        if (sdlContext.batching)
+        {
+            MD_DrawCommand command = make_image_command(sdl_src, MD_DrawCommand::IMAGE);
+            command.src = srcRect ? *srcRect : MD_Rect{ 0, 0, sdl_src->w, sdl_src->h };
+            command.dst = { touched.x, touched.y, 0, 0 };
+            if (md_clip_blit(sdl_src->w, sdl_src->h, command.clip, command.src, command.dst))
+            {
+                command.bounds = command.dst;
+                sdlContext.batch.Add(command);
+            }
+            return true;
+        }
+    }
+    else
+    {
+        // Drawing into an image that recorded draws may still read from
+        md_flush_draws();
+    }
     SDL_BlitSurface(sdl_src, sdl_srcRect, sdl_dest, sdl_destRect);
     return true;
 }
@@ -194,6 +598,35 @@ bool md_draw_image_scaled(MD_Image& image, MD_Rect* srcRect, MD_Image* dest, MD_
     SDL_Rect* sdl_srcRect = (SDL_Rect*)srcRect;
     SDL_Surface* sdl_dest = dest == nullptr ? sdlContext.canvas : (SDL_Surface*)dest;
     SDL_Rect* sdl_destRect = (SDL_Rect*)destRect;
+    MD_PROFILE_SCOPE(MD_STAT_DRAW_IMAGE_SCALED, destRect ? destRect->w * destRect->h : sdl_dest->w * sdl_dest->h);
+    if (dest == nullptr)
+    {
+        // SDL shrinks the destination when the source hangs off the image, so the recorded
+        // command has to as well or culling would count pixels it never writes as covered
+        MD_Rect area = srcRect ? *srcRect : MD_Rect{ 0, 0, sdl_src->w, sdl_src->h };
+        MD_Rect touched = destRect ? *destRect : MD_Rect{ 0, 0, sdl_dest->w, sdl_dest->h };
+        if (!md_clip_scaled_source(sdl_src->w, sdl_src->h, area, touched))
+        {
+            return true;
+        }
+        mark_canvas_dirty(touched);
+
+        if (sdlContext.batching)
+        {
+            MD_DrawCommand command = make_image_command(sdl_src, MD_DrawCommand::IMAGE_SCALED);
+            command.src = area;
+            command.dst = touched;
+            if (md_intersect_rect(touched, command.clip, command.bounds))
+            {
+                sdlContext.batch.Add(command);
+            }
+            return true;
+        }
+    }
+    else
+    {
+        md_flush_draws();
+    }
     SDL_BlitSurfaceScaled(sdl_src, sdl_srcRect, sdl_dest, sdl_destRect, SDL_SCALEMODE_NEAREST);
     return true;
 }
@@ -210,7 +643,26 @@ bool md_draw_image_scaled(MD_Image& image, MD_Rect& dest)
 
 void md_filled_rect(MD_Rect& rect, uint8_t r, uint8_t g, uint8_t b)
 {
+    MD_PROFILE_SCOPE(MD_STAT_FILLED_RECT, rect.w * rect.h);
     SDL_Rect* sdl_rect = (SDL_Rect*)&rect;
+    mark_canvas_dirty(rect);
+
+    if (sdlContext.batching)
+    {
+        MD_DrawCommand command;
+        command.type = MD_DrawCommand::FILL;
+        command.clip = get_canvas_clip();
+        command.r = r;
+        command.g = g;
+        command.b = b;
+        command.opaque = true;
+        if (md_intersect_rect(rect, command.clip, command.bounds))
+        {
+            command.dst = command.bounds;
+            sdlContext.batch.Add(command);
+        }
+        return;
+    }
     SDL_FillSurfaceRect(sdlContext.canvas, sdl_rect, SDL_MapSurfaceRGB(sdlContext.canvas, r, g, b));
 }
 
@@ -241,10 +693,19 @@ void md_set_colour_mod(MD_Image& image, uint8_t key_r, uint8_t key_g, uint8_t ke
     SDL_SetSurfaceColorMod((SDL_Surface*)&image, key_r, key_g, key_b);
 }
 
+void md_get_colour_mod(const MD_Image& image, uint8_t& r, uint8_t& g, uint8_t& b)
+{
+    SDL_GetSurfaceColorMod((SDL_Surface*)&image, &r, &g, &b);
+}
+
 //void GetPixelXBounds(SDL_Surface* surface, SDL_Rect rect, int& xLeftOut, int& xRightOut)
 void md_get_pixel_x_bounds(MD_Image& image, const MD_Rect& rect, int& xLeftOut, int& xRightOut)
 {
     SDL_Surface* surface = (SDL_Surface*)&image;
+    if (surface == sdlContext.canvas)
+    {
+        md_flush_draws();
+    }
 
     // Ensure we don't read outside surface boundaries
     int startX = std::max(0, rect.x);
@@ -254,17 +715,24 @@ void md_get_pixel_x_bounds(MD_Image& image, const MD_Rect& rect, int& xLeftOut,
 
     if (SDL_MUSTLOCK(surface)) SDL_LockSurface(surface);
 
-    Uint32* pixels = (Uint32*)surface->pixels;
-    int pitch = surface->pitch / sizeof(Uint32);
+    // Fonts are converted to the canvas format, which may be 16 or 32 bits per pixel
+    const Uint8* pixels = (const Uint8*)surface->pixels;
+    const int pitch = surface->pitch;
+    const bool is565 = surface->format == SDL_PIXELFORMAT_RGB565;
+    auto isLit = [&](int x, int y) {
+        if (is565) {
+            return ((const Uint16*)(pixels + (y * pitch)))[x] != 0;
+        }
+        // Check if pixel is not black (ignoring alpha channel)
+        return (((const Uint32*)(pixels + (y * pitch)))[x] & 0x00FFFFFF) != 0;
+    };
 
     // 1. Find Leftmost: Scan columns from left to right
     xLeftOut = rect.w;
     bool foundLeft = false;
     for (int x = startX; x < endX && !foundLeft; ++x) {
         for (int y = startY; y < endY; ++y) {
-            Uint32 pixel = pixels[y * pitch + x];
-            // Check if pixel is not black (ignoring alpha channel)
-            if ((pixel & 0x00FFFFFF) != 0) {
+            if (isLit(x, y)) {
                 xLeftOut = x - startX;
                 foundLeft = true;
                 break;
@@ -277,8 +745,7 @@ void md_get_pixel_x_bounds(MD_Image& image, const MD_Rect& rect, int& xLeftOut,
     bool foundRight = false;
     for (int x = endX - 1; x >= startX && !foundRight; --x) {
         for (int y = startY; y < endY; ++y) {
-            Uint32 pixel = pixels[y * pitch + x];
-            if ((pixel & 0x00FFFFFF) != 0) {
+            if (isLit(x, y)) {
                 xRightOut = x - startX;
                 foundRight = true;
                 break;
@@ -292,16 +759,187 @@ void md_get_pixel_x_bounds(MD_Image& image, const MD_Rect& rect, int& xLeftOut,
     }
 }
 
+void present_thread_main()
+{
+    PresentThread& pt = presentThread;
+    std::unique_lock<std::mutex> lock(pt.mutex);
+    while (true)
+    {
+        pt.cv.wait(lock, [&]() { return pt.quit || !pt.queue.empty(); });
+        if (pt.queue.empty())
+        {
+            return;
+        }
+
+        // The slot is ours until busy is cleared, so the slow part can run unlocked
+        const int slot = pt.queue.front();
+        pt.queue.pop_front();
+        lock.unlock();
+        blit_to_fb(pt.slots[slot].canvas, pt.slots[slot].dirty);
+        lock.lock();
+
+        pt.slots[slot].busy = false;
+        pt.cv.notify_all();
+    }
+}
+
+void start_present_thread(int numSlots)
+{
+    PresentThread& pt = presentThread;
+    pt.num_slots = std::clamp(numSlots, 2, MD_MAX_PRESENT_SLOTS);
+    pt.slots[0].canvas = sdlContext.canvas;
+    for (int i = 1; i < pt.num_slots; ++i)
+    {
+        SDL_Surface* canvas = sdlContext.canvas;
+        pt.slots[i].canvas = SDL_CreateSurface(canvas->w, canvas->h, canvas->format);
+    }
+    pt.drawing = 0;
+    pt.quit = false;
+    pt.thread = std::thread(present_thread_main);
+}
+
+void stop_present_thread()
+{
+    PresentThread& pt = presentThread;
+    if (!pt.thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pt.mutex);
+        pt.quit = true;
+    }
+    pt.cv.notify_all();
+    pt.thread.join();
+
+    // Go back to drawing into slot 0, the canvas md_init made, bringing it up to date with
+    // the slot being drawn into. The other slots' surfaces were made by start_present_thread.
+    md_flush_draws();
+    SDL_Surface* canvas = pt.slots[0].canvas;
+    if (pt.drawing != 0)
+    {
+        SDL_Surface* drawing = pt.slots[pt.drawing].canvas;
+        SDL_Rect clip;
+        SDL_GetSurfaceClipRect(drawing, &clip);
+        SDL_SetSurfaceClipRect(canvas, nullptr);
+        SDL_BlitSurface(drawing, nullptr, canvas, nullptr);
+        SDL_SetSurfaceClipRect(canvas, &clip);
+    }
+    sdlContext.canvas = canvas;
+    for (int i = 1; i < pt.num_slots; ++i)
+    {
+        SDL_DestroySurface(pt.slots[i].canvas);
+    }
+    for (PresentSlot& slot : pt.slots)
+    {
+        slot = PresentSlot();
+    }
+    pt.queue.clear();
+    pt.num_slots = 0;
+    pt.drawing = 0;
+}
+
+// Hand the finished canvas to the present thread and switch drawing to a free slot
+void submit_to_present_thread()
+{
+    PresentThread& pt = presentThread;
+    const int submitted = pt.drawing;
+    SDL_Surface* finished = pt.slots[submitted].canvas;
+    const DirtyRectList& dirty = sdlContext.dirty;
+
+    // Every other slot is now missing this frame's changes
+    for (int i = 0; i < pt.num_slots; ++i)
+    {
+        if (i == submitted)
+        {
+            continue;
+        }
+        for (int r = 0; r < dirty.m_Count; ++r)
+        {
+            pt.slots[i].stale.Add(dirty.m_Rects[r]);
+        }
+    }
+
+    int next = -1;
+    {
+        std::unique_lock<std::mutex> lock(pt.mutex);
+        pt.slots[submitted].dirty = dirty;
+        pt.slots[submitted].busy = true;
+        pt.queue.push_back(submitted);
+        pt.cv.notify_all();
+
+        // Oldest slots free up first, so walk forward from the one just submitted
+        pt.cv.wait(lock, [&]()
+        {
+            for (int i = 1; i < pt.num_slots; ++i)
+            {
+                const int candidate = (submitted + i) % pt.num_slots;
+                if (!pt.slots[candidate].busy)
+                {
+                    next = candidate;
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    // Bring the new slot up to date. The present thread only reads the finished
+    // canvas, so copying out of it while it's queued is safe.
+    PresentSlot& slot = pt.slots[next];
+
+    // The clip left over from the last frame drawn into this slot would cut the copy short
+    SDL_SetSurfaceClipRect(slot.canvas, nullptr);
+    for (int r = 0; r < slot.stale.m_Count; ++r)
+    {
+        SDL_Rect rect = *(const SDL_Rect*)&slot.stale.m_Rects[r];
+        SDL_BlitSurface(finished, &rect, slot.canvas, &rect);
+    }
+    slot.stale.Clear();
+
+    SDL_Rect clip;
+    SDL_GetSurfaceClipRect(finished, &clip);
+    SDL_SetSurfaceClipRect(slot.canvas, &clip);
+
+    pt.drawing = next;
+    sdlContext.canvas = slot.canvas;
+}
+
 void md_render()
 {
+    md_flush_draws();
+
     SDL_SetRenderDrawColor(sdlContext.ren, 255, 255, 255, 255);
     SDL_RenderClear(sdlContext.ren);
     //SDL_RenderCopy(ren, screen_tex, NULL, NULL);
-    SDL_UpdateTexture(sdlContext.screen_tex, NULL, sdlContext.canvas->pixels, sdlContext.canvas->pitch);
+
+    // Only upload the parts of the canvas that changed, the texture keeps the rest
+    SDL_Surface* canvas = sdlContext.canvas;
+    const DirtyRectList& dirty = sdlContext.dirty;
+    const int bytesPerPixel = SDL_BYTESPERPIXEL(canvas->format);
+    {
+        MD_PROFILE_SCOPE(MD_STAT_UPDATE_TEXTURE, dirty.GetPixelCount());
+        for (int i = 0; i < dirty.m_Count; ++i)
+        {
+            const MD_Rect& rect = dirty.m_Rects[i];
+            const Uint8* pixels = (const Uint8*)canvas->pixels + (rect.y * canvas->pitch) + (rect.x * bytesPerPixel);
+            SDL_UpdateTexture(sdlContext.screen_tex, (const SDL_Rect*)&rect, pixels, canvas->pitch);
+        }
+    }
     SDL_RenderTexture(sdlContext.ren, sdlContext.screen_tex, nullptr, nullptr);
 
     // 4. Update Display
-    blit_to_fb(sdlContext.canvas);
+    const bool idle = dirty.IsEmpty();
+    if (presentThread.num_slots > 0)
+    {
+        submit_to_present_thread();
+    }
+    else
+    {
+        blit_to_fb(canvas, dirty);
+    }
+    sdlContext.dirty.Clear();
 
     //static SDL_Rect blockout;
     //blockout.x = 13;
@@ -322,6 +960,9 @@ void md_render()
             sdlContext.exit_raised = true;
         }
     }
+
+    md_end_frame_stats();
+    md_pace_frame(idle);
 }
 
 bool md_exit_raised()
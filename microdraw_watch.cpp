@@ -0,0 +1,188 @@
+#include "microdraw_watch.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifdef __linux__
+#define MD_WATCH_INOTIFY
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+MD_FileWatcher::~MD_FileWatcher()
+{
+    Stop();
+}
+
+void MD_FileWatcher::Watch(const char* filename, MD_DataChangedFunc func)
+{
+    WatchedFile file;
+    file.filename = filename;
+
+    const size_t slash = file.filename.find_last_of("/\\");
+    if (slash == std::string::npos)
+    {
+        file.directory = ".";
+        file.name = file.filename;
+    }
+    else
+    {
+        file.directory = slash == 0 ? "/" : file.filename.substr(0, slash);
+        file.name = file.filename.substr(slash + 1);
+    }
+
+    m_Files.push_back(std::move(file));
+    m_Sources.Subscribe(filename, std::move(func));
+}
+
+bool MD_FileWatcher::Start(int pollMilliseconds)
+{
+    if (IsRunning())
+    {
+        return false;
+    }
+
+    m_PollMilliseconds = pollMilliseconds;
+    m_Stop = false;
+
+    // Watching starts before the first read, so a write in between isn't missed
+    OpenInotify();
+    m_Sources.Poll();
+
+    m_Thread = std::thread(&MD_FileWatcher::Run, this);
+    return true;
+}
+
+void MD_FileWatcher::Stop()
+{
+    if (!m_Thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_StopMutex);
+        m_Stop = true;
+    }
+    m_StopCondition.notify_all();
+#ifdef MD_WATCH_INOTIFY
+    if (m_WakeEvent >= 0)
+    {
+        // If this fails the thread still stops at its next poll timeout
+        const uint64_t wake = 1;
+        const ssize_t written = write(m_WakeEvent, &wake, sizeof(wake));
+        (void)written;
+    }
+#endif
+    m_Thread.join();
+    CloseInotify();
+}
+
+void MD_FileWatcher::OpenInotify()
+{
+#ifdef MD_WATCH_INOTIFY
+    m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_WakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_Inotify < 0 || m_WakeEvent < 0)
+    {
+        CloseInotify();
+        return;
+    }
+
+    // Directories rather than the files themselves, so a file replaced by renaming a new
+    // one over it is still seen. Files in the same directory share a watch.
+    for (WatchedFile& file : m_Files)
+    {
+        file.watch = inotify_add_watch(m_Inotify, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#endif
+}
+
+void MD_FileWatcher::CloseInotify()
+{
+#ifdef MD_WATCH_INOTIFY
+    if (m_Inotify >= 0)
+    {
+        close(m_Inotify);
+    }
+    if (m_WakeEvent >= 0)
+    {
+        close(m_WakeEvent);
+    }
+#endif
+    m_Inotify = -1;
+    m_WakeEvent = -1;
+    for (WatchedFile& file : m_Files)
+    {
+        file.watch = -1;
+    }
+}
+
+void MD_FileWatcher::Run()
+{
+    // The full check goes by the clock rather than by poll() timing out, as steady writes to
+    // other files in a watched directory would keep it from ever timing out
+    const std::chrono::milliseconds period(m_PollMilliseconds);
+    std::chrono::steady_clock::time_point nextFullPoll = std::chrono::steady_clock::now() + period;
+    while (!m_Stop)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= nextFullPoll)
+        {
+            m_Sources.Poll();
+            nextFullPoll = now + period;
+            continue;
+        }
+        const std::chrono::milliseconds wait = std::chrono::ceil<std::chrono::milliseconds>(nextFullPoll - now);
+
+#ifdef MD_WATCH_INOTIFY
+        if (m_Inotify >= 0)
+        {
+            pollfd fds[2] = { { m_Inotify, POLLIN, 0 }, { m_WakeEvent, POLLIN, 0 } };
+            const int ready = poll(fds, 2, (int)wait.count());
+            if (ready > 0 && !m_Stop && (fds[0].revents & POLLIN))
+            {
+                PollChangedFiles();
+            }
+            continue;
+        }
+#endif
+        std::unique_lock<std::mutex> lock(m_StopMutex);
+        m_StopCondition.wait_for(lock, wait, [this]() { return m_Stop.load(); });
+    }
+}
+
+// Checks the files named by queued inotify events. A burst of events for one file only
+// reads it once, MD_DataSources sees the later ones haven't changed its size or time.
+void MD_FileWatcher::PollChangedFiles()
+{
+#ifdef MD_WATCH_INOTIFY
+    alignas(inotify_event) char buffer[4096];
+    ssize_t bytes = 0;
+    while ((bytes = read(m_Inotify, buffer, sizeof(buffer))) > 0)
+    {
+        for (const char* cursor = buffer; cursor < buffer + bytes; )
+        {
+            const inotify_event* event = (const inotify_event*)cursor;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Events were dropped, so check everything
+                m_Sources.Poll();
+            }
+            else if (event->len > 0)
+            {
+                for (const WatchedFile& file : m_Files)
+                {
+                    if (file.watch == event->wd && file.name == event->name)
+                    {
+                        m_Sources.Poll(file.filename.c_str());
+                    }
+                }
+            }
+            cursor += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "microdraw_file.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Reloading data files off the render thread. A watcher thread parses files as they
+// change and publishes the results as snapshots, which the frame loop picks up.
+
+// The latest value published by one thread, for others to pick up. Values are immutable
+// once published, and stay alive for as long as anyone still holds them. Checking for a
+// new one is a single atomic load, so it's fine to do every frame.
+template <typename T>
+class MD_Snapshot
+{
+public:
+    void Publish(std::shared_ptr<const T> value)
+    {
+        m_Value.store(std::move(value), std::memory_order_release);
+        m_Version.fetch_add(1, std::memory_order_release);
+    }
+
+    std::shared_ptr<const T> Get() const
+    {
+        return m_Value.load(std::memory_order_acquire);
+    }
+
+    // Goes up by one for every Publish
+    uint32_t GetVersion() const
+    {
+        return m_Version.load(std::memory_order_acquire);
+    }
+
+    // Replace current with the latest value if there's been a Publish since the last call
+    // with this version. Returns true if it was replaced.
+    bool PickUp(std::shared_ptr<const T>& current, uint32_t& version) const
+    {
+        const uint32_t latest = GetVersion();
+        if (latest == version)
+        {
+            return false;
+        }
+        version = latest;
+        current = Get();
+        return true;
+    }
+
+private:
+    std::atomic<std::shared_ptr<const T>> m_Value;
+    std::atomic<uint32_t> m_Version { 0 };
+};
+
+// Calls a function for each watched file whenever its contents change, from a background
+// thread. On Linux inotify wakes the thread as soon as a file is written or replaced.
+// Everywhere a slow stat() poll runs as well, catching anything inotify can't see, such
+// as a directory that didn't exist yet. MD_DataSources does the change detection, so a
+// rewrite with the same bytes doesn't call anything.
+class MD_FileWatcher
+{
+public:
+    MD_FileWatcher() = default;
+    ~MD_FileWatcher();
+    MD_FileWatcher(const MD_FileWatcher&) = delete;
+    MD_FileWatcher& operator=(const MD_FileWatcher&) = delete;
+
+    // Only before Start(). func runs on the watcher thread.
+    void Watch(const char* filename, MD_DataChangedFunc func);
+
+    // Reads every file once on the calling thread, so their first results are ready before
+    // this returns, then carries on watching from a new thread
+    bool Start(int pollMilliseconds = 2000);
+    void Stop();
+
+    bool IsRunning() const { return m_Thread.joinable(); }
+    bool IsUsingInotify() const { return m_Inotify >= 0; }
+
+private:
+    struct WatchedFile
+    {
+        std::string filename;
+        std::string directory;
+        std::string name;           // Without the directory, as inotify reports it
+        int watch = -1;
+    };
+
+    void Run();
+    void OpenInotify();
+    void CloseInotify();
+    void PollChangedFiles();
+
+    MD_DataSources m_Sources;       // Only touched by the watcher thread once it's started
+    std::vector<WatchedFile> m_Files;
+    std::thread m_Thread;
+    int m_PollMilliseconds = 2000;
+
+    std::atomic<bool> m_Stop { false };
+    std::mutex m_StopMutex;
+    std::condition_variable m_StopCondition;
+
+    int m_Inotify = -1;
+    int m_WakeEvent = -1;           // Written by Stop() to break out of poll()
+};